@@ -44,8 +44,22 @@ ENDSEG   = SYSSEG + SYSSIZE		! where to stop loading
 
 ! ROOT_DEV:	0x000 - same type of floppy as boot.
 !		0x301 - first partition on first drive etc
+!		0x310 - first logical partition on first drive,
+!		0x328 - the same on the second drive
 ROOT_DEV = 0x306
 
+! NR_INODES: size of the in-core inode table, 0 lets the kernel
+!		pick one from the memory size. Can be patched in the image.
+NR_INODES = 0
+
+! BUFFER_K:	size of the buffer cache in kB, 0 lets the kernel pick
+!		one from the memory size. It grows past that at run time.
+BUFFER_K = 0
+
+! SWAP_DEV:	partition to page out to, 0x000 - no swapping. It has to
+!		be set up with mkswap, as in the 0.12 scheme.
+SWAP_DEV = 0
+
 entry start
 start:
 	mov	ax,#BOOTSEG
@@ -250,7 +264,13 @@ msg1:
 	.ascii "Loading system ..."
 	.byte 13,10,13,10
 
-.org 508
+.org 502
+buffer_k:
+	.word BUFFER_K
+swap_dev:
+	.word SWAP_DEV
+nr_inodes:
+	.word NR_INODES
 root_dev:
 	.word ROOT_DEV
 boot_flag:
@@ -189,14 +189,10 @@ ignore_int:
  * will be mapped to some other place - mm keeps track of
  * that.
  *
- * For those with more memory than 16 Mb - tough luck. I've
- * not got it, why should you :-) The source is here. Change
- * it. (Seriously - it shouldn't be too difficult. Mostly
- * change some constants etc. I left it at 16Mb, as my machine
- * even cannot be extended past that (ok, but it was cheap :-)
- * I've tried to show which constants to change by having
- * some kind of marker at them (search for "16Mb"), but I
- * won't guarantee that's all :-( )
+ * Memory above 16Mb is mapped later, by paging_init() in
+ * mm/memory.c, with page tables taken from main memory: doing it
+ * here would mean reserving room for them in the kernel image.
+ * The kernel segments below cover all 4Gb for the same reason.
  */
 .align 2
 setup_paging:
@@ -236,7 +232,7 @@ gdt_descr:
 _idt:	.fill 256,8,0		# idt is uninitialized
 
 _gdt:	.quad 0x0000000000000000	/* NULL descriptor */
-	.quad 0x00c09a0000000fff	/* 16Mb */
-	.quad 0x00c0920000000fff	/* 16Mb */
+	.quad 0x00cf9a000000ffff	/* 4Gb */
+	.quad 0x00cf92000000ffff	/* 4Gb */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use */
 	.fill 252,8,0			/* space for LDT's and TSS's etc */
@@ -49,6 +49,27 @@ start:
 	int	0x15
 	mov	[2],ax
 
+! 0x88 only has 16 bits of kB. Ask for the memory above 16M, in 64kB
+! blocks, too (0 if the bios doesn't know the 0xe801 call). Some bioses
+! leave ax/bx at 0 and only fill in cx/dx, which mean the same.
+
+	xor	bx,bx
+	xor	cx,cx
+	xor	dx,dx
+	mov	ax,#0xe801
+	int	0x15
+	jc	e801_none
+	or	ax,ax
+	jnz	e801_ok
+	or	bx,bx
+	jnz	e801_ok
+	mov	bx,dx
+	jmp	e801_ok
+e801_none:
+	xor	bx,bx
+e801_ok:
+	mov	[14],bx
+
 ! Get video-card data:
 
 	mov	ah,#0x0f
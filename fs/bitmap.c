@@ -10,13 +10,24 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 
-#define clear_block(addr)                          \
-	__asm__("cld\n\t"                              \
-			"rep\n\t"                              \
-			"stosl" ::"a"(0),                      \
-			"c"(BLOCK_SIZE / 4), "D"((long)(addr)) \
+#include <sys/stat.h>
+
+#define clear_block(addr, size)              \
+	__asm__("cld\n\t"                        \
+			"rep\n\t"                        \
+			"stosl" ::"a"(0),                \
+			"c"((size) / 4), "D"((long)(addr)) \
 			: "cx", "di")
 
+/*
+ * A bitmap block has 8192 bits with 1kB blocks, and 32768 with 4kB ones.
+ * MAP_BLOCK() is the bitmap block bit nr is in, MAP_BIT() the bit in it.
+ */
+#define MAP_SHIFT(sb) ((sb)->s_blocksize_bits + 3)
+#define MAP_BITS(sb) (1 << MAP_SHIFT(sb))
+#define MAP_BLOCK(sb, nr) ((nr) >> MAP_SHIFT(sb))
+#define MAP_BIT(sb, nr) ((nr) & (MAP_BITS(sb) - 1))
+
 //置指定地址nr位的bit位 返回以前的结果
 #define set_bit(nr, addr) ({\
 register int res __asm__("ax"); \
@@ -31,22 +42,77 @@ __asm__ __volatile__("btrl %2,%3\n\tsetnb %%al": \
 "=a" (res):"0" (0),"r" (nr),"m" (*(addr))); \
 res; })
 
-//找到为0的位 一般就是用来找位图中的0位 也就是找到对应还没有被使用的块
-#define find_first_zero(addr) ({ \
-int __res; \
-__asm__("cld\n" \
-	"1:\tlodsl\n\t" \
-	"notl %%eax\n\t" \
-	"bsfl %%eax,%%edx\n\t" \
-	"je 2f\n\t" \
-	"addl %%edx,%%ecx\n\t" \
-	"jmp 3f\n" \
-	"2:\taddl $32,%%ecx\n\t" \
-	"cmpl $8192,%%ecx\n\t" \
-	"jl 1b\n" \
-	"3:" \
-	:"=c" (__res):"c" (0),"S" (addr):"ax","dx","si"); \
-__res; })
+/*
+ * find_next_zero() finds the first zero bit in a bitmap block of 'size'
+ * bits from bit nr on. It returns size if there's none.
+ */
+static int find_next_zero(char *addr, int nr, int size)
+{
+	unsigned long *p = (nr >> 5) + (unsigned long *)addr;
+	unsigned long l;
+
+	if (nr & 31)
+	{
+		if (l = ~*p++ >> (nr & 31))
+			goto found;
+		nr = (nr + 31) & ~31;
+	}
+	for (; nr < size; nr += 32)
+		if (l = ~*p++)
+			goto found;
+	return size;
+found:
+	__asm__("bsfl %1,%0"
+			: "=r"(l)
+			: "r"(l));
+	return nr + l;
+}
+
+/*
+ * Every bitmap block has a count of its free bits, so that a search
+ * never looks at a full one, and s_free_zones/s_free_inodes have the
+ * totals for ustat(). They are counted when the filesystem is mounted,
+ * and kept up to date by the functions below from then on. Only the bits
+ * for blocks and inodes that exist are counted.
+ */
+static int count_zero(char *addr, int bits)
+{
+	unsigned long *p = (unsigned long *)addr;
+	unsigned long l;
+	int n = 0;
+
+	for (; bits > 0; bits -= 32)
+	{
+		l = ~*p++;
+		if (bits < 32)
+			l &= (1UL << bits) - 1;
+		for (; l; l &= l - 1)
+			n++;
+	}
+	return n;
+}
+
+void count_free(struct super_block *sb)
+{
+	int i, bits, size = MAP_BITS(sb);
+
+	sb->s_free_zones = sb->s_free_inodes = 0;
+	bits = sb->s_nzones - sb->s_firstdatazone + 1;
+	for (i = 0; i < Z_MAP_SLOTS; i++, bits -= size)
+	{
+		sb->s_zmap_free[i] = (bits > 0 && sb->s_zmap[i]) ?
+			count_zero(sb->s_zmap[i]->b_data, bits < size ? bits : size) : 0;
+		sb->s_free_zones += sb->s_zmap_free[i];
+	}
+	bits = sb->s_ninodes + 1;
+	for (i = 0; i < I_MAP_SLOTS; i++, bits -= size)
+	{
+		sb->s_imap_free[i] = (bits > 0 && sb->s_imap[i]) ?
+			count_zero(sb->s_imap[i]->b_data, bits < size ? bits : size) : 0;
+		sb->s_free_inodes += sb->s_imap_free[i];
+	}
+	sb->s_zmap_next = sb->s_imap_next = 0;
+}
 
 //释放对应设备的逻辑块
 void free_block(int dev, int block)
@@ -75,16 +141,59 @@ void free_block(int dev, int block)
 	//找到在数据库的偏移 逻辑块 数据块-->数据库就是从开始算的
 	block -= sb->s_firstdatazone - 1;
 	//第几个逻辑块的第几位
-	if (clear_bit(block & 8191, sb->s_zmap[block / 8192]->b_data))
+	if (clear_bit(MAP_BIT(sb, block), sb->s_zmap[MAP_BLOCK(sb, block)]->b_data))
 	{
 		printk("block (%04x:%d) ", dev, block + sb->s_firstdatazone - 1);
 		panic("free_block: bit already cleared");
 	}
-	sb->s_zmap[block / 8192]->b_dirt = 1;
+	sb->s_zmap[MAP_BLOCK(sb, block)]->b_dirt = 1;
+	sb->s_zmap_free[MAP_BLOCK(sb, block)]++;
+	sb->s_free_zones++;
+}
+
+/* a freshly allocated block reads as zeroes */
+static void zero_block(int dev, int block)
+{
+	struct buffer_head *bh;
+
+	if (!(bh = getblk(dev, block))) //给该块申请高速缓冲区
+		panic("new_block: cannot get block");
+	if (bh->b_count != 1) //证明分配的逻辑块还有在被使用
+		panic("new block: count is != 1");
+	clear_block(bh->b_data, bh->b_size);
+	bh->b_uptodate = 1;
+	bh->b_dirt = 1;
+	brelse(bh);
+}
+
+/*
+ * Search the bitmap blocks that have free bits, starting with the one
+ * that holds bit 'next' and going round. The first block is searched
+ * from 'next' on, and again from its start at the end. Returns the bit
+ * number, or -1 if everything is in use.
+ */
+static int find_free_bit(struct super_block *sb, struct buffer_head **map,
+						 unsigned short *nfree, unsigned long next)
+{
+	int i, j, k;
+
+	i = MAP_BLOCK(sb, next) & 7;
+	for (k = 0; k <= 8; k++, i = (i + 1) & 7)
+		if (nfree[i] && map[i] && (j = find_next_zero(map[i]->b_data,
+				k ? 0 : MAP_BIT(sb, next), MAP_BITS(sb))) < MAP_BITS(sb))
+			return (i << MAP_SHIFT(sb)) + j;
+	return -1;
 }
 
-//新建一个块的函数
-int new_block(int dev)
+/*
+ * new_block() looks for a free block from goal onwards, to the end of
+ * goal's bitmap block, and then goes on where the last search without a
+ * goal stopped. A goal of 0 means we don't care.
+ *
+ * The last s_reserved free blocks are promised to delayed blocks (see
+ * get_delayed()), and only flush_delayed() may take them: 'reserved'.
+ */
+static int _new_block(int dev, int goal, int reserved)
 {
 	struct buffer_head *bh;
 	struct super_block *sb;
@@ -92,31 +201,110 @@ int new_block(int dev)
 
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	//在该设备的所有逻辑块位图中找到第一个为0的逻辑块位图空位
-	for (i = 0; i < 8; i++)
-		if (bh = sb->s_zmap[i]) //对应高速缓冲区已经分配了 有对应的高速缓冲区
-			if ((j = find_first_zero(bh->b_data)) < 8192)
-				break;
-	if (i >= 8 || !bh || j >= 8192)
+	if (!reserved && sb->s_free_zones <= sb->s_reserved)
 		return 0;
+	if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+	{
+		goal -= sb->s_firstdatazone - 1;
+		i = MAP_BLOCK(sb, goal);
+		if (sb->s_zmap_free[i] && (bh = sb->s_zmap[i]) &&
+			(j = find_next_zero(bh->b_data, MAP_BIT(sb, goal),
+				MAP_BITS(sb))) < MAP_BITS(sb))
+			goto got_it;
+	}
+	//在该设备的逻辑块位图中找到一个为0的位
+	if ((j = find_free_bit(sb, sb->s_zmap, sb->s_zmap_free, sb->s_zmap_next)) < 0)
+		return 0;
+	sb->s_zmap_next = j + 1;
+	i = MAP_BLOCK(sb, j);
+	j = MAP_BIT(sb, j);
+	bh = sb->s_zmap[i];
+got_it:
 	if (set_bit(j, bh->b_data))
 		panic("new_block: bit already set");
 	bh->b_dirt = 1;
-	j += i * 8192 + sb->s_firstdatazone - 1; //计算为第几个逻辑块 block
+	j += (i << MAP_SHIFT(sb)) + sb->s_firstdatazone - 1; //计算为第几个逻辑块 block
 	if (j >= sb->s_nzones)
 		return 0;
-	if (!(bh = getblk(dev, j))) //给该块申请高速缓冲区
-		panic("new_block: cannot get block");
-	if (bh->b_count != 1) //证明分配的逻辑块还有在被使用
-		panic("new block: count is != 1");
-	clear_block(bh->b_data);
-	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
-	brelse(bh);
+	sb->s_zmap_free[i]--;
+	sb->s_free_zones--;
+	zero_block(dev, j);
 	return j;
 }
 
+int new_block(int dev, int goal)
+{
+	return _new_block(dev, goal, 0);
+}
+
+/*
+ * A regular file that needs a block gets it together with a window of
+ * up to PREALLOC free blocks right behind it, which are marked in the
+ * bitmap at once. Its next blocks come out of the window, so files
+ * written side by side don't end up interleaved on the disk. The rest
+ * of the window is given back by free_prealloc() when the inode is
+ * released or truncated.
+ */
+#define PREALLOC 8
+
+int new_file_block(struct m_inode *inode, int goal, int reserved)
+{
+	struct super_block *sb;
+	struct buffer_head *bh;
+	int block, nr;
+
+	if (inode->i_prealloc_count)
+	{
+		block = inode->i_prealloc++;
+		inode->i_prealloc_count--;
+		zero_block(inode->i_dev, block);
+		return block;
+	}
+	if (!(block = _new_block(inode->i_dev, goal, reserved)) ||
+		!S_ISREG(inode->i_mode))
+		return block;
+	sb = get_super(inode->i_dev);
+	inode->i_prealloc = block + 1;
+	for (nr = block + 1 - (sb->s_firstdatazone - 1);
+		 nr + sb->s_firstdatazone - 1 < sb->s_nzones; nr++)
+	{
+		if (inode->i_prealloc_count >= PREALLOC ||
+			sb->s_free_zones <= sb->s_reserved)
+			break;
+		bh = sb->s_zmap[MAP_BLOCK(sb, nr)];
+		if (!bh || set_bit(MAP_BIT(sb, nr), bh->b_data))
+			break;
+		bh->b_dirt = 1;
+		sb->s_zmap_free[MAP_BLOCK(sb, nr)]--;
+		sb->s_free_zones--;
+		inode->i_prealloc_count++;
+	}
+	return block;
+}
+
+void free_prealloc(struct m_inode *inode)
+{
+	struct super_block *sb;
+	struct buffer_head *bh;
+	int nr;
+
+	if (!inode->i_prealloc_count)
+		return;
+	if (!(sb = get_super(inode->i_dev)))
+		panic("free_prealloc: nonexistent device");
+	while (inode->i_prealloc_count)
+	{
+		nr = inode->i_prealloc++ - (sb->s_firstdatazone - 1);
+		inode->i_prealloc_count--;
+		if (!(bh = sb->s_zmap[MAP_BLOCK(sb, nr)]) ||
+			!clear_bit(MAP_BIT(sb, nr), bh->b_data))
+			panic("free_prealloc: block not reserved");
+		bh->b_dirt = 1;
+		sb->s_zmap_free[MAP_BLOCK(sb, nr)]++;
+		sb->s_free_zones++;
+	}
+}
+
 //释放指定的i节点
 void free_inode(struct m_inode *inode)
 {
@@ -127,7 +315,7 @@ void free_inode(struct m_inode *inode)
 		return;
 	if (!inode->i_dev) //设备号为0就是错误的直接清除返回
 	{
-		memset(inode, 0, sizeof(*inode));
+		clear_inode(inode);
 		return;
 	}
 	if (inode->i_count > 1)
@@ -141,12 +329,17 @@ void free_inode(struct m_inode *inode)
 		panic("trying to free inode on nonexistent device");
 	if (inode->i_num < 1 || inode->i_num > sb->s_ninodes)
 		panic("trying to free inode 0 or nonexistant inode");
-	if (!(bh = sb->s_imap[inode->i_num >> 13]))
+	if (!(bh = sb->s_imap[MAP_BLOCK(sb, inode->i_num)]))
 		panic("nonexistent imap in superblock");
-	if (clear_bit(inode->i_num & 8191, bh->b_data))
+	if (clear_bit(MAP_BIT(sb, inode->i_num), bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
+	else
+	{
+		sb->s_imap_free[MAP_BLOCK(sb, inode->i_num)]++;
+		sb->s_free_inodes++;
+	}
 	bh->b_dirt = 1; //回写信号
-	memset(inode, 0, sizeof(*inode));
+	clear_inode(inode);
 }
 
 struct m_inode *new_inode(int dev)
@@ -160,26 +353,30 @@ struct m_inode *new_inode(int dev)
 		return NULL;
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
-	j = 8192;
-	for (i = 0; i < 8; i++)
-		if (bh = sb->s_imap[i])
-			if ((j = find_first_zero(bh->b_data)) < 8192)
-				break;
-	if (!bh || j >= 8192 || j + i * 8192 > sb->s_ninodes)
+	if ((j = find_free_bit(sb, sb->s_imap, sb->s_imap_free, sb->s_imap_next)) < 0 ||
+		j > sb->s_ninodes)
 	{
 		iput(inode);
 		return NULL;
 	}
+	sb->s_imap_next = j + 1;
+	i = MAP_BLOCK(sb, j);
+	j = MAP_BIT(sb, j);
+	bh = sb->s_imap[i];
 	if (set_bit(j, bh->b_data))
 		panic("new_inode: bit already set");
 	bh->b_dirt = 1;
+	sb->s_imap_free[i]--;
+	sb->s_free_inodes--;
 	inode->i_count = 1;
 	inode->i_nlinks = 1;
 	inode->i_dev = dev;
 	inode->i_uid = current->euid;
 	inode->i_gid = current->egid;
 	inode->i_dirt = 1;
-	inode->i_num = j + i * 8192;
+	inode->i_num = j + (i << MAP_SHIFT(sb));
+	inode->i_blkbits = sb->s_blocksize_bits;
+	insert_inode_hash(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
\ No newline at end of file
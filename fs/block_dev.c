@@ -11,20 +11,25 @@
 #include <asm/segment.h>
 #include <asm/system.h>
 
+/*
+ * A block device is read and written in the block size it has right now,
+ * so that a mounted filesystem with 4kB blocks shares the buffers.
+ */
 int block_write(int dev, long * pos, char * buf, int count)
 {
-	int block = *pos >> BLOCK_SIZE_BITS;
-	int offset = *pos & (BLOCK_SIZE-1);
+	int size = get_blocksize(dev);
+	int block = *pos / size;
+	int offset = *pos & (size-1);
 	int chars;
 	int written = 0;
 	struct buffer_head * bh;
 	register char * p;
 
 	while (count>0) {
-		chars = BLOCK_SIZE - offset;
+		chars = size - offset;
 		if (chars > count)
 			chars=count;
-		if (chars == BLOCK_SIZE)
+		if (chars == size)
 			bh = getblk(dev,block);
 		else
 			bh = breada(dev,block,block+1,block+2,-1);
@@ -36,8 +41,9 @@ int block_write(int dev, long * pos, char * buf, int count)
 		*pos += chars;
 		written += chars;
 		count -= chars;
-		while (chars-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,chars);
+		buf += chars;
+		bh->b_uptodate = 1;
 		bh->b_dirt = 1;
 		brelse(bh);
 	}
@@ -46,15 +52,16 @@ int block_write(int dev, long * pos, char * buf, int count)
 
 int block_read(int dev, unsigned long * pos, char * buf, int count)
 {
-	int block = *pos >> BLOCK_SIZE_BITS;
-	int offset = *pos & (BLOCK_SIZE-1);
+	int size = get_blocksize(dev);
+	int block = *pos / size;
+	int offset = *pos & (size-1);
 	int chars;
 	int read = 0;
 	struct buffer_head * bh;
 	register char * p;
 
 	while (count>0) {
-		chars = BLOCK_SIZE-offset;
+		chars = size-offset;
 		if (chars > count)
 			chars = count;
 		if (!(bh = breada(dev,block,block+1,block+2,-1)))
@@ -65,8 +72,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 		*pos += chars;
 		read += chars;
 		count -= chars;
-		while (chars-->0)
-			put_fs_byte(*(p++),buf++);
+		memcpy_tofs(buf,p,chars);
+		buf += chars;
 		brelse(bh);
 	}
 	return read;
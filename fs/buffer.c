@@ -19,20 +19,61 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
+#include <string.h>
 
 #include <linux/config.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
 #include <asm/io.h>
+#include <asm/segment.h>
 
 extern int end; //这个end 就是内核结束的位置
 struct buffer_head *start_buffer = (struct buffer_head *)&end;
-struct buffer_head *hash_table[NR_HASH];
-static struct buffer_head *free_list;		   //空的高速缓冲区指针 循环链表
+static struct buffer_head **hash_table;
+static int nr_hash = 0;
+static int hash_shift = 0;
+static struct buffer_head *all_buffers = NULL; /* through b_next_all */
+static char *static_buffer_end = NULL;
+static struct buffer_head *lru_list[NR_LIST];  //未使用缓冲区的lru循环链表 clean/dirty
+static int nr_buffers_type[NR_LIST];
 static struct task_struct *buffer_wait = NULL; //当高速缓冲区被写满时 直接等待高速缓冲区
 int NR_BUFFERS = 0;
 
+/* statistics, see show_buffers() */
+static unsigned long nr_hits = 0;
+static unsigned long nr_misses = 0;
+static unsigned long nr_probes = 0;
+static unsigned long nr_readahead = 0;
+static unsigned long nr_grown = 0;
+static unsigned long nr_shrunk = 0;
+static unsigned long nr_regrouped = 0;
+
+/*
+ * Write-back tuning. A buffer is due BDF_AGE ticks after it was first
+ * released dirty. The daemon wakes up every BDF_INTERVAL ticks and
+ * writes at most BDF_BATCH due buffers per round. Once more than
+ * BDF_DIRTY_RATIO percent of the cache is dirty it is woken at once,
+ * and ignores the age until it is down to half of that.
+ */
+#define BDF_AGE (5 * HZ)
+#define BDF_INTERVAL HZ
+#define BDF_BATCH 64
+#define BDF_DIRTY_RATIO 40
+
+#define over_dirty_ratio(ratio) \
+	(nr_buffers_type[BUF_DIRTY] * 100 > NR_BUFFERS * (ratio))
+
+static struct task_struct *bdflush_wait = NULL;
+static int bdflush_running = 0;
+static struct timer_list bdflush_timer; /* the next periodic run */
+static unsigned long nr_flushed = 0;
+static unsigned long nr_bdflush_runs = 0;
+static unsigned long nr_fg_writes = 0;
+static unsigned long nr_dirty_victims = 0;
+
 static inline void wait_on_buffer(struct buffer_head *bh)
 {
 	cli();
@@ -41,18 +82,22 @@ static inline void wait_on_buffer(struct buffer_head *bh)
 	sti();
 }
 
+static void refile_buffer(struct buffer_head *bh);
+
 int sys_sync(void)
 {
-	int i;
 	struct buffer_head *bh;
 
+	sync_delayed(0, 1);
 	sync_inodes(); /* write out inodes into buffers */
-	bh = start_buffer;
-	for (i = 0; i < NR_BUFFERS; i++, bh++)
+	for (bh = all_buffers; bh; bh = bh->b_next_all)
 	{
 		wait_on_buffer(bh);
 		if (bh->b_dirt)
+		{
 			ll_rw_block(WRITE, bh); //块设备读写驱动函数通用函数
+			refile_buffer(bh);
+		}
 	}
 	return 0;
 }
@@ -60,44 +105,49 @@ int sys_sync(void)
 //同步设备 就是写盘操作
 int sync_dev(int dev)
 {
-	int i;
 	struct buffer_head *bh;
 
-	bh = start_buffer;
-	for (i = 0; i < NR_BUFFERS; i++, bh++)
+	sync_delayed(dev, 1);
+	for (bh = all_buffers; bh; bh = bh->b_next_all)
 	{
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_dirt)
+		{
 			ll_rw_block(WRITE, bh); // ll low level 底层的块设备读写函数
+			refile_buffer(bh);
+		}
 	}
 	sync_inodes();
-	bh = start_buffer;
-	for (i = 0; i < NR_BUFFERS; i++, bh++)
+	for (bh = all_buffers; bh; bh = bh->b_next_all)
 	{
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_dirt)
+		{
 			ll_rw_block(WRITE, bh);
+			refile_buffer(bh);
+		}
 	}
 	return 0;
 }
 
 void inline invalidate_buffers(int dev)
 {
-	int i;
 	struct buffer_head *bh;
 
-	bh = start_buffer;
-	for (i = 0; i < NR_BUFFERS; i++, bh++)
+	for (bh = all_buffers; bh; bh = bh->b_next_all)
 	{
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev)
+		{
 			bh->b_uptodate = bh->b_dirt = 0;
+			refile_buffer(bh);
+		}
 	}
 }
 
@@ -127,54 +177,121 @@ void check_disk_change(int dev)
 		if (super_block[i].s_dev == dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
+	dcache_invalidate_dev(dev);
 	invalidate_buffers(dev);
 }
 
-#define _hashfn(dev, block) (((unsigned)(dev ^ block)) % NR_HASH)
+/*
+ * The hash table is sized to the cache at boot, a power of two with a
+ * bucket per buffer or so, and indexed by the top bits of a
+ * multiplicative hash. (dev ^ block) % 307 put the consecutive blocks
+ * of different devices right on top of each other.
+ */
+#define _hashfn(dev, block) \
+	((((unsigned)(block) ^ ((unsigned)(dev) << 16)) * 0x9e370001) >> hash_shift)
 #define hash(dev, block) hash_table[_hashfn(dev, block)]
 
-static inline void remove_from_queues(struct buffer_head *bh)
+static inline void remove_from_hash_queue(struct buffer_head *bh)
 {
-	/* remove from hash-queue */
 	if (bh->b_next)
 		bh->b_next->b_prev = bh->b_prev;
 	if (bh->b_prev)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev, bh->b_blocknr) == bh)
 		hash(bh->b_dev, bh->b_blocknr) = bh->b_next;
-	/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+	bh->b_next = bh->b_prev = NULL;
 }
 
-static inline void insert_into_queues(struct buffer_head *bh)
+static inline void insert_into_hash_queue(struct buffer_head *bh)
 {
-	/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
-	/* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
 	if (!bh->b_dev)
 		return;
 	bh->b_next = hash(bh->b_dev, bh->b_blocknr);
 	hash(bh->b_dev, bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+static void idle_group_add(struct buffer_head *bh);
+static void idle_group_remove(struct buffer_head *bh);
+
+/*
+ * The lru lists only ever hold unused buffers, so taking a buffer into
+ * use or putting it back is O(1), and getblk() finds its victim at the
+ * head of the clean list instead of walking the whole cache.
+ */
+static inline void remove_from_lru_list(struct buffer_head *bh)
+{
+	if (!(bh->b_prev_free) || !(bh->b_next_free))
+		panic("Free block list corrupted");
+	if (bh->b_list != BUF_DIRTY)
+		idle_group_remove(bh);
+	bh->b_prev_free->b_next_free = bh->b_next_free;
+	bh->b_next_free->b_prev_free = bh->b_prev_free;
+	if (lru_list[bh->b_list] == bh)
+		lru_list[bh->b_list] = bh->b_next_free;
+	if (lru_list[bh->b_list] == bh)
+		lru_list[bh->b_list] = NULL;
+	bh->b_next_free = bh->b_prev_free = NULL;
+	nr_buffers_type[bh->b_list]--;
 }
 
+#define clean_list(size) ((size) == BLOCK_SIZE ? BUF_CLEAN : BUF_PAGE)
+#define lru_list_of(bh) ((bh)->b_dirt ? BUF_DIRTY : clean_list((bh)->b_size))
+
+/* put at the end (most recently used) of the list matching b_dirt */
+static inline void insert_into_lru_list(struct buffer_head *bh)
+{
+	struct buffer_head **list;
+
+	if ((bh->b_list = lru_list_of(bh)) == BUF_DIRTY)
+	{
+		if (!bh->b_flushtime)
+			bh->b_flushtime = jiffies + BDF_AGE;
+	}
+	else
+		bh->b_flushtime = 0;
+	list = lru_list + bh->b_list;
+	if (!*list)
+	{
+		*list = bh;
+		bh->b_prev_free = bh;
+	}
+	bh->b_next_free = *list;
+	bh->b_prev_free = (*list)->b_prev_free;
+	(*list)->b_prev_free->b_next_free = bh;
+	(*list)->b_prev_free = bh;
+	nr_buffers_type[bh->b_list]++;
+	if (bh->b_list != BUF_DIRTY)
+		idle_group_add(bh);
+}
+
+/*
+ * An unused buffer whose dirt changed behind our back (it was written
+ * out by sync, or invalidated) has to move to the other list.
+ */
+static void refile_buffer(struct buffer_head *bh)
+{
+	if (bh->b_count || bh->b_list == lru_list_of(bh))
+		return;
+	remove_from_lru_list(bh);
+	insert_into_lru_list(bh);
+}
+
+/*
+ * A buffer of the wrong size can only be there if it was in use when
+ * set_blocksize() ran, and it doesn't count.
+ */
 //在hash table上寻找对应块结构
-static struct buffer_head *find_buffer(int dev, int block)
+static struct buffer_head *find_buffer(int dev, int block, int size)
 {
 	struct buffer_head *tmp;
 
 	for (tmp = hash(dev, block); tmp != NULL; tmp = tmp->b_next)
-		if (tmp->b_dev == dev && tmp->b_blocknr == block)
+		if (tmp->b_dev == dev && tmp->b_blocknr == block &&
+			tmp->b_size == size)
 			return tmp;
 	return NULL;
 }
@@ -186,20 +303,350 @@ static struct buffer_head *find_buffer(int dev, int block)
  * will force it bad). This shouldn't really happen currently, but
  * the code is ready.
  */
-struct buffer_head *get_hash_table(int dev, int block)
+static struct buffer_head *find_hash_table(int dev, int block, int size)
 {
 	struct buffer_head *bh;
 
 	for (;;)
 	{
-		if (!(bh = find_buffer(dev, block)))
+		if (!(bh = find_buffer(dev, block, size)))
 			return NULL;
-		bh->b_count++; //先占用
+		if (!bh->b_count++) //先占用
+			remove_from_lru_list(bh);
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_blocknr == block)
+		if (bh->b_dev == dev && bh->b_blocknr == block && bh->b_size == size)
 			return bh;
-		bh->b_count--; //如果不是则释放
+		if (!--bh->b_count) //如果不是则释放
+			insert_into_lru_list(bh);
+	}
+}
+
+struct buffer_head *get_hash_table(int dev, int block)
+{
+	return find_hash_table(dev, block, get_blocksize(dev));
+}
+
+/*
+ * Devices are read in BLOCK_SIZE blocks, unless set_blocksize() said
+ * otherwise: a filesystem with 4kB blocks does that while it's mounted,
+ * so there are never more entries than super blocks.
+ */
+static struct
+{
+	unsigned short dev;
+	unsigned short size;
+} blksize_table[NR_SUPER];
+static int nr_blksize = 0;
+
+int get_blocksize(int dev)
+{
+	int i;
+
+	for (i = 0; i < nr_blksize; i++)
+		if (blksize_table[i].dev == dev)
+			return blksize_table[i].size;
+	return BLOCK_SIZE;
+}
+
+/*
+ * Only 1kB and page sized blocks are possible. The floppy driver does a
+ * single 1kB block per command, so floppies stay at that. The unused
+ * buffers of the device are written out if need be and thrown away, as
+ * they would be in the way of the new ones.
+ */
+int set_blocksize(int dev, int size)
+{
+	struct buffer_head *bh;
+	int i;
+
+	if (size != BLOCK_SIZE && (size != PAGE_SIZE || MAJOR(dev) == 2))
+		return -EINVAL;
+	if (get_blocksize(dev) == size)
+		return 0;
+	for (i = 0; i < nr_blksize && blksize_table[i].dev != dev; i++)
+		;
+	if (size == BLOCK_SIZE)
+		blksize_table[i] = blksize_table[--nr_blksize];
+	else
+	{
+		if (nr_blksize >= NR_SUPER)
+			return -EBUSY;
+		blksize_table[nr_blksize].dev = dev;
+		blksize_table[nr_blksize].size = size;
+		nr_blksize++;
+	}
+	for (bh = all_buffers; bh; bh = bh->b_next_all)
+	{
+		if (bh->b_dev != dev)
+			continue;
+		wait_on_buffer(bh);
+		if (bh->b_dev == dev && bh->b_dirt)
+		{
+			ll_rw_block(WRITE, bh);
+			wait_on_buffer(bh);
+		}
+		if (bh->b_dev != dev || bh->b_count || bh->b_dirt)
+			continue;
+		remove_from_hash_queue(bh);
+		bh->b_dev = 0;
+		bh->b_uptodate = 0;
+		refile_buffer(bh);
+	}
+	return 0;
+}
+
+/*
+ * Buffer memory comes in pages, each with a group of BUFS_PER_PAGE
+ * buffer heads of its own: BUFS_PER_PAGE 1kB buffers, or one page sized
+ * buffer in the first head with the others idle (no b_data, on no list).
+ * A group whose buffers are all unused, clean and unlocked can be given
+ * the other size by regroup_buffers(), which is how the buffers for a
+ * filesystem with 4kB blocks are found.
+ *
+ * The cache can grow past what was set up at boot. When there is no
+ * clean unused buffer left - ie we are busy writing - and memory isn't
+ * tight, getblk() takes a free page and makes a group of it instead of
+ * waiting for a dirty one to go out. shrink_buffers() gives such pages
+ * back when get_free_page() runs dry.
+ *
+ * The heads for them come from pages of their own, and are never freed:
+ * a group whose page has been given back just waits on unused_groups
+ * for the next one.
+ */
+#define BUFS_PER_PAGE (PAGE_SIZE / BLOCK_SIZE)
+#define BUFFER_RESERVE 128 /* free pages the cache leaves alone */
+
+/* the first head of the group a buffer is in */
+#define group_of(bh) \
+	((bh) - ((unsigned long)(bh)->b_data & (PAGE_SIZE - 1)) / BLOCK_SIZE)
+
+static struct buffer_head *unused_groups = NULL; /* through b_next_free */
+static int nr_grown_pages = 0;
+
+/*
+ * A group with all its buffers on a clean list is idle, and goes on one
+ * of these circular lists, by clean list and by whether its page was
+ * grown, oldest first. That's where regroup_buffers() and
+ * shrink_buffers() look, so they never have to walk the cache. b_idle
+ * in the first head counts the buffers of the group on a clean list.
+ */
+static struct buffer_head *idle_groups[NR_LIST][2]; /* through b_next_idle */
+
+#define grown_group(first) ((first)->b_data >= static_buffer_end)
+
+static void idle_group_add(struct buffer_head *bh)
+{
+	struct buffer_head *first = group_of(bh), **list;
+
+	if (++first->b_idle != PAGE_SIZE / bh->b_size)
+		return;
+	list = idle_groups[bh->b_list] + grown_group(first);
+	if (!*list)
+	{
+		*list = first;
+		first->b_prev_idle = first;
+	}
+	first->b_next_idle = *list;
+	first->b_prev_idle = (*list)->b_prev_idle;
+	(*list)->b_prev_idle->b_next_idle = first;
+	(*list)->b_prev_idle = first;
+}
+
+static void idle_group_remove(struct buffer_head *bh)
+{
+	struct buffer_head *first = group_of(bh), **list;
+
+	if (first->b_idle-- != PAGE_SIZE / bh->b_size)
+		return;
+	list = idle_groups[bh->b_list] + grown_group(first);
+	first->b_prev_idle->b_next_idle = first->b_next_idle;
+	first->b_next_idle->b_prev_idle = first->b_prev_idle;
+	if (*list == first)
+		*list = first->b_next_idle;
+	if (*list == first)
+		*list = NULL;
+	first->b_next_idle = first->b_prev_idle = NULL;
+}
+
+static struct buffer_head *get_buffer_group(void)
+{
+	struct buffer_head *bh;
+	unsigned long page;
+	int i, n;
+
+	if (!unused_groups)
+	{
+		if (!(page = get_free_page_atomic()))
+			return NULL;
+		bh = (struct buffer_head *)page;
+		n = PAGE_SIZE / sizeof(struct buffer_head) / BUFS_PER_PAGE;
+		for (i = 0; i < n * BUFS_PER_PAGE; i++)
+		{
+			bh[i].b_next_all = all_buffers;
+			all_buffers = bh + i;
+		}
+		for (i = 0; i < n; i++, bh += BUFS_PER_PAGE)
+		{
+			bh->b_next_free = unused_groups;
+			unused_groups = bh;
+		}
+	}
+	bh = unused_groups;
+	unused_groups = bh->b_next_free;
+	bh->b_next_free = NULL;
+	return bh;
+}
+
+static void fill_group(struct buffer_head *first, unsigned long page, int size)
+{
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / size; i++)
+	{
+		first[i].b_data = (char *)page + i * size;
+		first[i].b_size = size;
+		insert_into_lru_list(first + i);
+		NR_BUFFERS++;
+	}
+}
+
+/* takes the buffers of an unused group out of the cache, returns the page */
+static unsigned long empty_group(struct buffer_head *first)
+{
+	unsigned long page = (unsigned long)first->b_data;
+	int i;
+
+	/* all off the lru lists first: that needs b_data for group_of() */
+	for (i = 0; i < BUFS_PER_PAGE; i++)
+		if (first[i].b_data)
+			remove_from_lru_list(first + i);
+	for (i = 0; i < BUFS_PER_PAGE; i++)
+	{
+		if (!first[i].b_data)
+			continue;
+		remove_from_hash_queue(first + i);
+		first[i].b_dev = 0;
+		first[i].b_uptodate = 0;
+		first[i].b_data = NULL;
+		first[i].b_size = 0;
+		NR_BUFFERS--;
 	}
+	return page;
+}
+
+/*
+ * Look for a group that is entirely unused, clean and unlocked among the
+ * idle groups of a clean list, oldest first. The only ones passed over
+ * have a buffer with I/O in flight, so this is bounded by the requests.
+ * With 'grown' only grown pages will do.
+ */
+static struct buffer_head *find_unused_group(int list, int grown)
+{
+	struct buffer_head *first;
+	int i;
+
+	for (; grown < 2; grown++)
+	{
+		if (!(first = idle_groups[list][grown]))
+			continue;
+		do
+		{
+			for (i = 0; i < BUFS_PER_PAGE; i++)
+				if (first[i].b_count || first[i].b_dirt || first[i].b_lock)
+					break;
+			if (i == BUFS_PER_PAGE)
+				return first;
+		} while ((first = first->b_next_idle) != idle_groups[list][grown]);
+	}
+	return NULL;
+}
+
+static int grow_buffers(int size)
+{
+	struct buffer_head *bh;
+	unsigned long page;
+
+	if (free_page_count() < BUFFER_RESERVE + nr_grown_pages)
+		return 0;
+	if (!(bh = get_buffer_group()))
+		return 0;
+	if (!(page = get_free_page_atomic()))
+	{
+		bh->b_next_free = unused_groups;
+		unused_groups = bh;
+		return 0;
+	}
+	fill_group(bh, page, size);
+	nr_grown_pages++;
+	nr_grown++;
+	return 1;
+}
+
+/* give the page of an unused group of the other size to 'size' buffers */
+static int regroup_buffers(int size)
+{
+	struct buffer_head *first;
+
+	if (!(first = find_unused_group(size == BLOCK_SIZE ? BUF_PAGE : BUF_CLEAN, 0)))
+		return 0;
+	fill_group(first, empty_group(first), size);
+	nr_regrouped++;
+	return 1;
+}
+
+/* give back a grown page whose buffers are all unused, clean and unlocked */
+int shrink_buffers(void)
+{
+	struct buffer_head *first;
+
+	if (!(first = find_unused_group(BUF_PAGE, 1)) &&
+		!(first = find_unused_group(BUF_CLEAN, 1)))
+		return 0;
+	free_page(empty_group(first));
+	first->b_next_free = unused_groups;
+	unused_groups = first;
+	nr_grown_pages--;
+	nr_shrunk++;
+	return 1;
+}
+
+/*
+ * Find an unused buffer of the given size to recycle. The clean lists
+ * are kept in lru order, so normally the head of the right one is the
+ * answer. Locked buffers are there while I/O on them is in flight: a
+ * read-ahead, or a write that was refiled to the clean list as soon as
+ * it was started (sync, bdflush, a dirty victim). Either way they are
+ * queued, so the loop is bounded by the buffers the queued requests
+ * hold, not by the size of the cache.
+ */
+static struct buffer_head *get_free_buffer(int size)
+{
+	struct buffer_head *bh;
+	int list = clean_list(size);
+
+	if ((bh = lru_list[list]))
+		do
+		{
+			nr_probes++;
+			if (!bh->b_lock)
+				return bh;
+		} while ((bh = bh->b_next_free) != lru_list[list]);
+	if (grow_buffers(size) || regroup_buffers(size))
+		return lru_list[list]->b_prev_free;
+	nr_probes++;
+	if ((bh = lru_list[BUF_DIRTY]))
+		return bh;
+	return lru_list[list]; /* all locked: wait for one */
+}
+
+static void wakeup_bdflush(void)
+{
+	wake_up(&bdflush_wait);
+}
+
+static void bdflush_timeout(unsigned long unused)
+{
+	wake_up(&bdflush_wait);
 }
 
 /*
@@ -207,62 +654,190 @@ struct buffer_head *get_hash_table(int dev, int block)
  * race-conditions. Most of the code is seldom used, (ie repeating),
  * so it should be much more efficient than it looks.
  *
- * The algoritm is changed: hopefully better, and an elusive bug removed.
+ * Victims come from the head of the clean lru list. Only when there
+ * are no clean unused buffers left do we write back the oldest dirty
+ * one - just that one, the rest is left to the bdflush daemon.
  */
-#define BADNESS(bh) (((bh)->b_dirt << 1) + (bh)->b_lock)
 //指定设备号（dev）和所要访问设备数据的逻辑块号（block）
 //高速缓冲区在块设备与内核其他程序之间起着一个桥梁作用。除了块设备驱动程序 以外，内核程序如果需要访问块设备中的数据，就都需要经过高速缓冲区来间接地操作。
-struct buffer_head *getblk(int dev, int block)
+/*
+ * Returns an unused, unlocked and clean buffer of the given size, or
+ * NULL if we had to sleep to get one: the caller has to look at the
+ * cache again then.
+ */
+static struct buffer_head *get_victim(int size)
 {
-	struct buffer_head *tmp, *bh;
+	struct buffer_head *bh;
 
-repeat:
-	if (bh = get_hash_table(dev, block))
-		return bh;
-	tmp = free_list;
-	do
-	{
-		if (tmp->b_count)
-			continue;
-		if (!bh || BADNESS(tmp) < BADNESS(bh))
-		{
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-		/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-	if (!bh)
+	if (!(bh = get_free_buffer(size)))
 	{
 		sleep_on(&buffer_wait);
-		goto repeat;
+		return NULL;
 	}
 	wait_on_buffer(bh);
 	if (bh->b_count) //确保在等待过程中找到的高速缓冲区没有被使用
-		goto repeat;
-	while (bh->b_dirt) //如果该块是有参与数据的则进行回写同步
+		return NULL;
+	if (bh->b_dirt) //如果该块是有参与数据的则进行回写
 	{
-		sync_dev(bh->b_dev);
-		wait_on_buffer(bh);
-		if (bh->b_count)
-			goto repeat;
+		nr_dirty_victims++;
+		wakeup_bdflush();
+		if (bh->b_dirt)
+		{
+			nr_fg_writes++;
+			ll_rw_block(WRITE, bh);
+			refile_buffer(bh);
+			wait_on_buffer(bh);
+		}
+		return NULL;
 	}
+	if (bh->b_size != size) /* shrunk or regrouped while we slept */
+		return NULL;
+	return bh;
+}
+
+struct buffer_head *getblk(int dev, int block)
+{
+	struct buffer_head *bh;
+	int size = get_blocksize(dev);
+
+repeat:
+	if (bh = find_hash_table(dev, block, size))
+	{
+		nr_hits++;
+		return bh;
+	}
+	if (!(bh = get_victim(size)))
+		goto repeat;
 	/* NOTE!! While we slept waiting for this block, somebody else might */
 	/* already have added "this" block to the cache. check it */
-	if (find_buffer(dev, block)) //这个函数如果找到表示这个块已经存在与hash散列上被使用了
+	if (find_buffer(dev, block, size)) //这个函数如果找到表示这个块已经存在与hash散列上被使用了
 		goto repeat;
 	/* OK, FINALLY we know that this buffer is the only one of it's kind, */
 	/* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
+	nr_misses++;
+	remove_from_lru_list(bh); //从lru队列 hash表移除
+	remove_from_hash_queue(bh);
 	bh->b_count = 1;
 	bh->b_dirt = 0;
 	bh->b_uptodate = 0;
-	remove_from_queues(bh); //从free队列 hash表移除
 	bh->b_dev = dev;
 	bh->b_blocknr = block;
-	insert_into_queues(bh); //新的排列 free队列 和 新hash表项
+	insert_into_hash_queue(bh); //新的hash表项
 	return bh;
 }
 
+/*
+ * A buffer for data that has no block on the disk yet, see the delayed
+ * allocation in inode.c. It is on no hash chain and has b_dev 0, so the
+ * write-back never sees it.
+ */
+struct buffer_head *get_unhashed_buffer(int size)
+{
+	struct buffer_head *bh;
+
+	while (!(bh = get_victim(size)))
+		/* nothing */;
+	remove_from_lru_list(bh);
+	remove_from_hash_queue(bh);
+	bh->b_count = 1;
+	bh->b_dirt = 0;
+	bh->b_uptodate = 0;
+	bh->b_dev = 0;
+	bh->b_blocknr = 0;
+	return bh;
+}
+
+/*
+ * Drop a reference without waiting for pending I/O. The buffer goes
+ * to the tail of its lru list when the last user lets go of it.
+ */
+static inline void put_buffer(struct buffer_head *buf)
+{
+	if (!(buf->b_count--))
+		panic("Trying to free free buffer");
+	if (!buf->b_count)
+	{
+		insert_into_lru_list(buf);
+		if (buf->b_list == BUF_DIRTY && over_dirty_ratio(BDF_DIRTY_RATIO))
+			wakeup_bdflush();
+	}
+	wake_up(&buffer_wait);
+}
+
+/*
+ * Write out up to BDF_BATCH buffers from the head of the dirty list,
+ * stopping at the first one not yet due unless 'force' is set. Each
+ * buffer is taken off the list while we may sleep on it, and goes to
+ * the clean list when we let go of it again.
+ */
+static int flush_dirty_buffers(int force)
+{
+	struct buffer_head *bh;
+	int n;
+
+	for (n = 0; n < BDF_BATCH && (bh = lru_list[BUF_DIRTY]); n++)
+	{
+		if (!force && bh->b_flushtime > (unsigned long)jiffies)
+			break;
+		remove_from_lru_list(bh);
+		bh->b_count++;
+		ll_rw_block(WRITE, bh);
+		put_buffer(bh);
+		nr_flushed++;
+	}
+	return n;
+}
+
+/*
+ * bdflush(BDF_RUN) is called by a child of init right after the root
+ * is mounted, and turns it into the write-back daemon: it never returns
+ * unless it gets a signal.
+ */
+int sys_bdflush(int func, long data)
+{
+	int i, dirty;
+	long stats[BDF_NSTATS];
+
+	if (func == BDF_STATS)
+	{
+		stats[0] = NR_BUFFERS;
+		stats[1] = nr_buffers_type[BUF_DIRTY];
+		stats[2] = nr_flushed;
+		stats[3] = nr_bdflush_runs;
+		stats[4] = nr_fg_writes;
+		stats[5] = nr_dirty_victims;
+		verify_area((void *)data, sizeof(stats));
+		for (i = 0; i < BDF_NSTATS; i++)
+			put_fs_long(stats[i], i + (unsigned long *)data);
+		return 0;
+	}
+	if (func != BDF_RUN)
+		return -EINVAL;
+	if (!suser())
+		return -EPERM;
+	if (bdflush_running)
+		return -EBUSY;
+	bdflush_running = 1;
+	for (;;)
+	{
+		nr_bdflush_runs++;
+		sync_delayed(0, 0);
+		sync_inodes();
+		flush_dirty_buffers(0);
+		dirty = nr_buffers_type[BUF_DIRTY];
+		if (over_dirty_ratio(BDF_DIRTY_RATIO / 2) &&
+			flush_dirty_buffers(1) && nr_buffers_type[BUF_DIRTY] < dirty)
+			continue;
+		if (!timer_pending(&bdflush_timer))
+			mod_timer(&bdflush_timer, jiffies + BDF_INTERVAL);
+		interruptible_sleep_on(&bdflush_wait);
+		if (current->signal & ~current->blocked)
+			break;
+	}
+	bdflush_running = 0;
+	return -EINTR;
+}
+
 // 1.释放对应的高速缓冲区
 // 2.唤醒等待空闲缓冲区的进程
 // 释放指定缓冲块。
@@ -273,9 +848,7 @@ void brelse(struct buffer_head *buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
-	if (!(buf->b_count--))
-		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	put_buffer(buf);
 }
 
 /*
@@ -299,28 +872,22 @@ struct buffer_head *bread(int dev, int block)
 	return NULL;
 }
 
-// cld 将标志寄存器Flag的方向标志位DF清零。
-// rep rep指令作用是重复 后面的指令
-// movsl 表示从esi所指地方复制长字到edi所指地方,并使esi和edi分别加4。
-#define COPYBLK(from, to)                      \
-	__asm__("cld\n\t"                          \		
-			"rep\n\t"                          \
-			"movsl\n\t" ::"c"(BLOCK_SIZE / 4), \
-			"S"(from), "D"(to)                 \
-			: "cx", "di", "si")
-
 /*
- * bread_page reads four buffers into memory at the desired address. It's
- * a function of its own, as there is some speed to be got by reading them
- * all at the same time, not waiting for one to be read, and then another
- * etc.
+ * bread_page reads a page worth of blocks into memory at the desired
+ * address, starting 'offset' bytes into the first one: four 1kB blocks,
+ * or one or two page sized ones. A 0 in b[] is a hole, and leaves that
+ * part of the page alone. It's a function of its own, as there is some
+ * speed to be got by reading them all at the same time, not waiting for
+ * one to be read, and then another etc.
  */
-void bread_page(unsigned long address, int dev, int b[4]) //一页 4k
+void bread_page(unsigned long address, int dev, int b[], int offset) //一页 4k
 {
-	struct buffer_head *bh[4];
-	int i;
+	struct buffer_head *bh[BUFS_PER_PAGE];
+	int i, n, size, chars, left;
 
-	for (i = 0; i < 4; i++)
+	size = get_blocksize(dev);
+	n = (offset + PAGE_SIZE + size - 1) / size;
+	for (i = 0; i < n; i++)
 		if (b[i])
 		{
 			if (bh[i] = getblk(dev, b[i]))
@@ -329,14 +896,38 @@ void bread_page(unsigned long address, int dev, int b[4]) //一页 4k
 		}
 		else
 			bh[i] = NULL;
-	for (i = 0; i < 4; i++, address += BLOCK_SIZE)
+	for (i = 0, left = PAGE_SIZE; i < n; i++, offset = 0)
+	{
+		chars = size - offset;
+		if (chars > left)
+			chars = left;
 		if (bh[i])
 		{
 			wait_on_buffer(bh[i]);
 			if (bh[i]->b_uptodate)
-				COPYBLK((unsigned long)bh[i]->b_data, address);
+				memcpy((void *)address, bh[i]->b_data + offset, chars);
 			brelse(bh[i]);
 		}
+		address += chars;
+		left -= chars;
+	}
+}
+
+/*
+ * bread_ahead() starts reading a block that will be wanted soon, and
+ * returns at once. If there is no free request it is simply forgotten.
+ */
+void bread_ahead(int dev, int block)
+{
+	struct buffer_head *bh;
+
+	bh = getblk(dev, block);
+	if (!bh->b_uptodate)
+	{
+		nr_readahead++;
+		ll_rw_block(READA, bh);
+	}
+	put_buffer(bh);
 }
 
 /*
@@ -360,8 +951,8 @@ struct buffer_head *breada(int dev, int first, ...)
 		if (tmp)
 		{
 			if (!tmp->b_uptodate)
-				ll_rw_block(READA, bh);
-			tmp->b_count--;
+				ll_rw_block(READA, tmp);
+			put_buffer(tmp);
 		}
 	}
 	va_end(args);
@@ -375,36 +966,66 @@ struct buffer_head *breada(int dev, int first, ...)
 //高速缓冲区初始化程序（空闲缓冲区和双向循环链表的创建）
 void buffer_init(long buffer_end)
 {
-	struct buffer_head *h = start_buffer;
+	struct buffer_head *h;
 	void *b;
-	int i;
+	int i, j;
 	//如果缓冲区高端等于1Mb，则由于从640KB-1MB 被显示内存和BIOS 占用，因此实际可用缓冲区内存 高端应该是640KB。否则内存高端一定大于1MB。
 	if (buffer_end == 1 << 20) // 1024k
 		b = (void *)(640 * 1024);
 	else
 		b = (void *)buffer_end;
-	while ((b -= BLOCK_SIZE) >= ((void *)(h + 1)))
+	static_buffer_end = (char *)buffer_end;
+	/* the hash table goes first, then the buffer heads */
+	i = ((long)b - (long)&end) / (BLOCK_SIZE + sizeof(struct buffer_head));
+	for (nr_hash = 256, hash_shift = 24; nr_hash < i && nr_hash < 65536; nr_hash <<= 1)
+		hash_shift--;
+	hash_table = (struct buffer_head **)&end;
+	for (i = 0; i < nr_hash; i++)
+		hash_table[i] = NULL;
+	start_buffer = h = (struct buffer_head *)(hash_table + nr_hash);
+	for (i = 0; i < NR_LIST; i++)
 	{
-		h->b_dev = 0;
-		h->b_dirt = 0;
-		h->b_count = 0;
-		h->b_lock = 0;
-		h->b_uptodate = 0;
-		h->b_wait = NULL;
-		h->b_next = NULL;
-		h->b_prev = NULL;
-		h->b_data = (char *)b;
-		h->b_prev_free = h - 1;
-		h->b_next_free = h + 1;
-		h++;
-		NR_BUFFERS++;
+		lru_list[i] = NULL;
+		nr_buffers_type[i] = 0;
+		idle_groups[i][0] = idle_groups[i][1] = NULL;
+	}
+	init_timer(&bdflush_timer);
+	bdflush_timer.function = bdflush_timeout;
+	/* a page at a time, from the top, each with a group of heads */
+	while ((b -= PAGE_SIZE) >= ((void *)(h + BUFS_PER_PAGE)))
+	{
+		for (j = 0; j < BUFS_PER_PAGE; j++, h++)
+		{
+			h->b_dev = 0;
+			h->b_dirt = 0;
+			h->b_count = 0;
+			h->b_lock = 0;
+			h->b_uptodate = 0;
+			h->b_wait = NULL;
+			h->b_next = NULL;
+			h->b_prev = NULL;
+			h->b_flushtime = 0;
+			h->b_reqnext = NULL;
+			h->b_idle = 0;
+			h->b_next_idle = h->b_prev_idle = NULL;
+			h->b_next_all = all_buffers;
+			all_buffers = h;
+		}
+		fill_group(h - BUFS_PER_PAGE, (unsigned long)b, BLOCK_SIZE);
 		if (b == (void *)0x100000)
 			b = (void *)0xA0000;
 	}
-	h--;
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;
-	for (i = 0; i < NR_HASH; i++)
-		hash_table[i] = NULL;
+}
+
+void show_buffers(void)
+{
+	printk("%d buffers, %d clean, %d clean page sized and %d dirty unused\n\r",
+		   NR_BUFFERS, nr_buffers_type[BUF_CLEAN], nr_buffers_type[BUF_PAGE],
+		   nr_buffers_type[BUF_DIRTY]);
+	printk("buffer cache: %d hits, %d misses, %d victim probes, %d read-ahead\n\r",
+		   nr_hits, nr_misses, nr_probes, nr_readahead);
+	printk("buffer cache: %d hash buckets, %d pages grown (%d now), %d given back, %d regrouped\n\r",
+		   nr_hash, nr_grown, nr_grown_pages, nr_shrunk, nr_regrouped);
+	printk("bdflush: %d runs, %d flushed, %d dirty victims, %d foreground writes\n\r",
+		   nr_bdflush_runs, nr_flushed, nr_dirty_victims, nr_fg_writes);
 }
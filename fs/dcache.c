@@ -0,0 +1,202 @@
+/*
+ *  linux/fs/dcache.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * The directory name cache. It remembers which inode a name in a
+ * directory refers to, or that there is no such name, so that looking
+ * up a path doesn't have to read and search the directory blocks every
+ * time. Entries are keyed by the directory's (dev,inode) and the name,
+ * and a fixed number of them are recycled in lru order.
+ *
+ * Anything that changes a directory has to drop the affected names:
+ * add_entry(), unlink, rmdir and mount/umount do. dcache_version counts
+ * those changes, so that a lookup which slept in find_entry() doesn't
+ * put back a name that went stale meanwhile.
+ */
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#define NR_DCACHE 256
+#define NR_DHASH 127
+
+struct dcache_entry
+{
+	unsigned short dev, dir;
+	unsigned short ino; /* 0: known not to exist */
+	unsigned char namelen;
+	char name[NAME_LEN];
+	struct dcache_entry *next_hash, **pprev_hash;
+	struct dcache_entry *next_lru, *prev_lru;
+};
+
+static struct dcache_entry dcache[NR_DCACHE];
+static struct dcache_entry *dhash[NR_DHASH];
+static struct dcache_entry *lru_head = NULL; /* least recently used */
+
+unsigned long dcache_version = 0;
+
+static unsigned long nr_dc_hits = 0;
+static unsigned long nr_dc_neg_hits = 0;
+static unsigned long nr_dc_misses = 0;
+
+static inline int dhashfn(int dev, int dir, const char *name, int len)
+{
+	unsigned long h = dev ^ dir;
+
+	while (len--)
+		h = (h << 3) + (h >> 28) + *(unsigned char *)name++;
+	return h % NR_DHASH;
+}
+
+static inline void dremove_hash(struct dcache_entry *de)
+{
+	if (!de->pprev_hash)
+		return;
+	if ((*de->pprev_hash = de->next_hash) != NULL)
+		de->next_hash->pprev_hash = de->pprev_hash;
+	de->next_hash = NULL;
+	de->pprev_hash = NULL;
+}
+
+static inline void dinsert_hash(struct dcache_entry *de)
+{
+	struct dcache_entry **head = dhash +
+		dhashfn(de->dev, de->dir, de->name, de->namelen);
+
+	if ((de->next_hash = *head) != NULL)
+		(*head)->pprev_hash = &de->next_hash;
+	*head = de;
+	de->pprev_hash = head;
+}
+
+/* move to the most recently used end */
+static inline void dtouch(struct dcache_entry *de)
+{
+	if (de == lru_head)
+	{
+		lru_head = de->next_lru;
+		return;
+	}
+	de->prev_lru->next_lru = de->next_lru;
+	de->next_lru->prev_lru = de->prev_lru;
+	de->next_lru = lru_head;
+	de->prev_lru = lru_head->prev_lru;
+	lru_head->prev_lru->next_lru = de;
+	lru_head->prev_lru = de;
+}
+
+/* unused entries go to the least recently used end */
+static inline void dforget(struct dcache_entry *de)
+{
+	dremove_hash(de);
+	dtouch(de);
+	lru_head = de;
+}
+
+static struct dcache_entry *dfind(int dev, int dir, const char *name, int len)
+{
+	struct dcache_entry *de;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	for (de = dhash[dhashfn(dev, dir, name, len)]; de; de = de->next_hash)
+		if (de->dev == dev && de->dir == dir && de->namelen == len &&
+			!strncmp(de->name, name, len))
+			return de;
+	return NULL;
+}
+
+/*
+ * Returns the inode number, 0 if the name is known not to exist, and -1
+ * if it isn't cached. The name is in kernel space.
+ */
+int dcache_lookup(int dev, int dir, const char *name, int len)
+{
+	struct dcache_entry *de;
+
+	if (!(de = dfind(dev, dir, name, len)))
+	{
+		nr_dc_misses++;
+		return -1;
+	}
+	dtouch(de);
+	if (de->ino)
+		nr_dc_hits++;
+	else
+		nr_dc_neg_hits++;
+	return de->ino;
+}
+
+void dcache_add(int dev, int dir, const char *name, int len, int ino)
+{
+	struct dcache_entry *de;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if (!(de = dfind(dev, dir, name, len)))
+	{
+		de = lru_head;
+		dremove_hash(de);
+		de->dev = dev;
+		de->dir = dir;
+		de->namelen = len;
+		strncpy(de->name, name, len);
+		dinsert_hash(de);
+	}
+	de->ino = ino;
+	dtouch(de);
+}
+
+void dcache_remove(int dev, int dir, const char *name, int len)
+{
+	struct dcache_entry *de;
+
+	dcache_version++;
+	if (de = dfind(dev, dir, name, len))
+		dforget(de);
+}
+
+/* a directory went away, its inode number may get used again */
+void dcache_invalidate_dir(int dev, int dir)
+{
+	int i;
+
+	dcache_version++;
+	for (i = 0; i < NR_DCACHE; i++)
+		if (dcache[i].pprev_hash && dcache[i].dev == dev &&
+			dcache[i].dir == dir)
+			dforget(dcache + i);
+}
+
+void dcache_invalidate_dev(int dev)
+{
+	int i;
+
+	dcache_version++;
+	for (i = 0; i < NR_DCACHE; i++)
+		if (dcache[i].pprev_hash && dcache[i].dev == dev)
+			dforget(dcache + i);
+}
+
+void dcache_init(void)
+{
+	int i;
+
+	for (i = 0; i < NR_DCACHE; i++)
+	{
+		dcache[i].next_lru = dcache + (i + 1) % NR_DCACHE;
+		dcache[i].prev_lru = dcache + (i + NR_DCACHE - 1) % NR_DCACHE;
+	}
+	lru_head = dcache;
+}
+
+void show_dcache(void)
+{
+	printk("dcache: %d hits, %d negative hits, %d misses\n\r",
+		   nr_dc_hits, nr_dc_neg_hits, nr_dc_misses);
+}
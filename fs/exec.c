@@ -177,7 +177,7 @@ static unsigned long change_ldt(unsigned long text_size, unsigned long *page)
 
 	code_limit = text_size + PAGE_SIZE - 1;
 	code_limit &= 0xFFFFF000;
-	data_limit = 0x4000000;
+	data_limit = TASK_SIZE;
 	code_base = get_base(current->ldt[1]);
 	data_base = code_base;
 	set_base(current->ldt[1], code_base);
@@ -242,6 +242,7 @@ restart_interp:
 		retval = -EACCES;
 		goto exec_error2;
 	}
+	flush_delayed(inode); /* do_no_page() only knows about real blocks */
 	i = inode->i_mode; // file permission inspect
 	e_uid = (i & S_ISUID) ? inode->i_uid : current->euid;
 	e_gid = (i & S_ISGID) ? inode->i_gid : current->egid;
@@ -399,8 +400,9 @@ restart_interp:
 		if ((current->close_on_exec >> i) & 1)
 			sys_close(i);
 	current->close_on_exec = 0;
-	free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+	free_page_tables(task_dir(current), get_base(current->ldt[1]), get_limit(0x0f));
+	free_page_tables(task_dir(current), get_base(current->ldt[2]), get_limit(0x17));
+	vfork_release();
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
@@ -14,27 +14,78 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * Read-ahead window in blocks: it starts at READA_MIN when a file is
+ * read sequentially, doubles with every further sequential block up to
+ * READA_MAX, and drops to nothing as soon as the reader jumps around.
+ */
+#define READA_MIN 4
+#define READA_MAX 32
+
+static void file_readahead(struct m_inode * inode, struct file * filp,
+	unsigned long block)
+{
+	unsigned long end, last;
+	int zones[READA_MAX];
+	int i,n;
+
+	if (block == filp->f_ranext) {
+		if (!filp->f_rawin)
+			filp->f_rawin = READA_MIN;
+		else if (filp->f_rawin < READA_MAX)
+			filp->f_rawin <<= 1;
+	} else if (block+1 != filp->f_ranext) {	/* not just the same block again */
+		filp->f_rawin = 0;
+		filp->f_raend = block+1;
+	}
+	filp->f_ranext = block+1;
+	if (filp->f_raend < block+1)
+		filp->f_raend = block+1;
+	if (!filp->f_rawin)
+		return;
+/* wait until half of the window is used up, so the reads come in batches */
+	if (filp->f_raend - (block+1) > filp->f_rawin/2)
+		return;
+	end = block+1+filp->f_rawin;
+	last = (inode->i_size+I_BLOCK_SIZE(inode)-1) >> inode->i_blkbits;
+	if (end > last)
+		end = last;
+	while (filp->f_raend < end) {
+		n = bmap_range(inode,filp->f_raend,zones,MIN(end-filp->f_raend,READA_MAX));
+		if (!n)
+			break;
+		for (i=0 ; i<n ; i++)
+			if (zones[i])
+				bread_ahead(inode->i_dev,zones[i]);
+		filp->f_raend += n;
+	}
+}
+
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
+	int left,chars,nr,block;
+	int size = I_BLOCK_SIZE(inode);
 	struct buffer_head * bh;
 
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
+		block = filp->f_pos >> inode->i_blkbits;
+		file_readahead(inode,filp,block);
+		if (bh = get_delayed(inode,block,0))
+			;
+		else if (nr = bmap(inode,block)) {
 			if (!(bh=bread(inode->i_dev,nr)))
 				break;
 		} else
 			bh = NULL;
-		nr = filp->f_pos % BLOCK_SIZE;
-		chars = MIN( BLOCK_SIZE-nr , left );
+		nr = filp->f_pos & (size-1);
+		chars = MIN( size-nr , left );
 		filp->f_pos += chars;
 		left -= chars;
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++);
+			memcpy_tofs(buf,nr+bh->b_data,chars);
+			buf += chars;
 			brelse(bh);
 		} else {
 			while (chars-->0)
@@ -49,6 +100,7 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 {
 	off_t pos;
 	int block,c;
+	int size = I_BLOCK_SIZE(inode);
 	struct buffer_head * bh;
 	char * p;
 	int i=0;
@@ -61,15 +113,28 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		pos = inode->i_size;
 	else
 		pos = filp->f_pos;
+/* cached text pages of this file are about to be wrong */
+	free_text_pages(inode);
 	while (i<count) {
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+		c = pos & (size-1);
+		if ((bh = get_delayed(inode,pos >> inode->i_blkbits,1)) ==
+		    NO_DELAY_SPACE) {
+			if (!i)
+				return -ENOSPC;
+			break;
+		} else if (bh)
+			;
+		else if (!(block = create_block(inode,pos >> inode->i_blkbits)))
 			break;
-		if (!(bh=bread(inode->i_dev,block)))
+/* no need to read a block we are going to overwrite completely */
+		else if (!c && count-i >= size)
+			bh = getblk(inode->i_dev,block);
+		else if (!(bh=bread(inode->i_dev,block)))
 			break;
-		c = pos % BLOCK_SIZE;
 		p = c + bh->b_data;
-		bh->b_dirt = 1;
-		c = BLOCK_SIZE-c;
+		if (bh->b_dev)
+			bh->b_dirt = 1;
+		c = size-c;
 		if (c > count-i) c = count-i;
 		pos += c;
 		if (pos > inode->i_size) {
@@ -77,8 +142,9 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			inode->i_dirt = 1;
 		}
 		i += c;
-		while (c-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,c);
+		buf += c;
+		bh->b_uptodate = 1;
 		brelse(bh);
 	}
 	inode->i_mtime = CURRENT_TIME;
@@ -13,11 +13,32 @@
 #include <asm/system.h>
 
 // inode有很多 这个就是用来快速管理inode节点的
-struct m_inode inode_table[NR_INODE] = {
-	{
-		0,
-	},
-};
+/*
+ * The in-core inode table is set up by inode_init() at boot, and its
+ * size is picked by main() from the amount of memory or from the boot
+ * sector. Inodes in use are found through a hash on (dev,nr). Unused
+ * ones (i_count == 0) are kept on a circular lru list, blank ones at
+ * the front, so get_empty_inode() recycles the least recently used and
+ * iget() can still find a cached inode that nobody holds.
+ */
+struct m_inode *inode_table;
+int nr_inodes = 0;
+
+#define NR_IHASH 509
+#define ihashfn(dev, nr) (((unsigned)((dev) ^ (nr))) % NR_IHASH)
+#define ihash(dev, nr) inode_hash[ihashfn(dev, nr)]
+
+static struct m_inode *inode_hash[NR_IHASH];
+static struct m_inode *free_inodes = NULL;
+
+static unsigned long nr_iget_hits = 0;
+static unsigned long nr_iget_misses = 0;
+static unsigned long nr_iget_probes = 0;
+static unsigned long nr_delayed = 0;
+static unsigned long nr_delay_flushed = 0;
+static unsigned long nr_delay_discarded = 0;
+static unsigned long nr_bmap_hits = 0;
+static unsigned long nr_bmap_lookups = 0;
 
 static void read_inode(struct m_inode *inode);
 static void write_inode(struct m_inode *inode);
@@ -26,7 +47,10 @@ static inline void wait_on_inode(struct m_inode *inode)
 {
 	cli();
 	while (inode->i_lock)
+	{
+		inode->i_lock = 2; /* wanted: see unlock_pipe() */
 		sleep_on(&inode->i_wait);
+	}
 	sti();
 }
 
@@ -34,7 +58,10 @@ static inline void lock_inode(struct m_inode *inode)
 {
 	cli();
 	while (inode->i_lock)
+	{
+		inode->i_lock = 2;
 		sleep_on(&inode->i_wait);
+	}
 	inode->i_lock = 1;
 	sti();
 }
@@ -45,6 +72,99 @@ static inline void unlock_inode(struct m_inode *inode)
 	wake_up(&inode->i_wait);
 }
 
+void insert_inode_hash(struct m_inode *inode)
+{
+	struct m_inode **head = &ihash(inode->i_dev, inode->i_num);
+
+	if ((inode->i_hash_next = *head) != NULL)
+		(*head)->i_hash_pprev = &inode->i_hash_next;
+	*head = inode;
+	inode->i_hash_pprev = head;
+}
+
+static inline void remove_inode_hash(struct m_inode *inode)
+{
+	if (!inode->i_hash_pprev)
+		return;
+	if ((*inode->i_hash_pprev = inode->i_hash_next) != NULL)
+		inode->i_hash_next->i_hash_pprev = inode->i_hash_pprev;
+	inode->i_hash_next = NULL;
+	inode->i_hash_pprev = NULL;
+}
+
+/* blank inodes go to the front of the unused list, cached ones to the back */
+static inline void put_unused_inode(struct m_inode *inode)
+{
+	if (!free_inodes)
+	{
+		free_inodes = inode->i_free_next = inode->i_free_prev = inode;
+		return;
+	}
+	inode->i_free_next = free_inodes;
+	inode->i_free_prev = free_inodes->i_free_prev;
+	free_inodes->i_free_prev->i_free_next = inode;
+	free_inodes->i_free_prev = inode;
+	if (!inode->i_dev)
+		free_inodes = inode;
+}
+
+static inline void remove_unused_inode(struct m_inode *inode)
+{
+	if (!inode->i_free_next)
+		return;
+	if (inode->i_free_next == inode)
+		free_inodes = NULL;
+	else
+	{
+		inode->i_free_prev->i_free_next = inode->i_free_next;
+		inode->i_free_next->i_free_prev = inode->i_free_prev;
+		if (free_inodes == inode)
+			free_inodes = inode->i_free_next;
+	}
+	inode->i_free_next = inode->i_free_prev = NULL;
+}
+
+/*
+ * Wipe an inode that isn't wanted any more (free_inode() uses this), and
+ * put it on the unused list if nobody holds it.
+ */
+void clear_inode(struct m_inode *inode)
+{
+	free_text_pages(inode);
+	remove_inode_hash(inode);
+	remove_unused_inode(inode);
+	memset(inode, 0, sizeof(*inode));
+	put_unused_inode(inode);
+}
+
+long inode_init(long mem_start, int nr)
+{
+	long size;
+	int i;
+
+	if (nr < 32)
+		nr = 32;
+	if (nr > 8192)
+		nr = 8192;
+	nr_inodes = nr;
+	inode_table = (struct m_inode *)mem_start;
+	size = PAGE_ALIGN(nr * sizeof(struct m_inode));
+	memset(inode_table, 0, size);
+	for (i = 0; i < NR_INODE; i++)
+		put_unused_inode(inode_table + i);
+	return size;
+}
+
+void show_inodes(void)
+{
+	printk("inodes: %d in core, %d iget hits, %d misses, %d hash probes\n\r",
+		   NR_INODE, nr_iget_hits, nr_iget_misses, nr_iget_probes);
+	printk("delayed blocks: %d waiting, %d allocated, %d never allocated\n\r",
+		   nr_delayed, nr_delay_flushed, nr_delay_discarded);
+	printk("bmap: %d from the run cache, %d indirect lookups\n\r",
+		   nr_bmap_hits, nr_bmap_lookups);
+}
+
 //释放对应设备下的所有inode节点  这是内存中正在操作的inode节点
 void invalidate_inodes(int dev)
 {
@@ -59,6 +179,9 @@ void invalidate_inodes(int dev)
 		{
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			remove_inode_hash(inode);
+			free_text_pages(inode);
+			discard_delayed(inode);
 			inode->i_dev = inode->i_dirt = 0;
 		}
 	}
@@ -78,20 +201,38 @@ void sync_inodes(void)
 	}
 }
 
+static int _bmap(struct m_inode *inode, int block, int create);
+
+/*
+ * A new block for a file goes right behind the one before it, if that
+ * exists, so that a file written in order is in order on the disk. The
+ * indirect blocks come from the same place, just ahead of the data
+ * they map.
+ */
+static int bmap_new(struct m_inode *inode, int block, int create)
+{
+	int goal = 0;
+
+	if (block > 0 && (goal = bmap(inode, block - 1)))
+		goal++;
+	return new_file_block(inode, goal, create > 1);
+}
+
 // create 是否创建新的逻辑块 1创建 0不创建
+/* 2 is flush_delayed(), which may use the zones reserved for it */
 static int _bmap(struct m_inode *inode, int block, int create)
 {
 	struct buffer_head *bh;
-	int i;
+	int i, nr = block;
 
 	if (block < 0)
 		panic("_bmap: block<0");
-	if (block >= 7 + 512 + 512 * 512)
+	if (block >= MAX_FILE_BLOCKS(inode))
 		panic("_bmap: block>big");
 	if (block < 7)
 	{
 		if (create && !inode->i_zone[block])
-			if (inode->i_zone[block] = new_block(inode->i_dev))
+			if (inode->i_zone[block] = bmap_new(inode, nr, create))
 			{
 				inode->i_ctime = CURRENT_TIME;
 				inode->i_dirt = 1;
@@ -99,11 +240,11 @@ static int _bmap(struct m_inode *inode, int block, int create)
 		return inode->i_zone[block];
 	}
 	block -= 7;
-	if (block < 512)
+	if (block < ADDR_PER_BLOCK(inode))
 	{
 		// 先创建用来存储一次间接块的块
 		if (create && !inode->i_zone[7])
-			if (inode->i_zone[7] = new_block(inode->i_dev))
+			if (inode->i_zone[7] = bmap_new(inode, nr, create))
 			{
 				inode->i_dirt = 1;
 				inode->i_ctime = CURRENT_TIME;
@@ -115,7 +256,7 @@ static int _bmap(struct m_inode *inode, int block, int create)
 		i = ((unsigned short *)(bh->b_data))[block];
 		// 创建对应的逻辑块
 		if (create && !i)
-			if (i = new_block(inode->i_dev))
+			if (i = bmap_new(inode, nr, create))
 			{
 				((unsigned short *)(bh->b_data))[block] = i;
 				bh->b_dirt = 1;
@@ -124,9 +265,9 @@ static int _bmap(struct m_inode *inode, int block, int create)
 		return i;
 	}
 	//  > 512的处理
-	block -= 512;
+	block -= ADDR_PER_BLOCK(inode);
 	if (create && !inode->i_zone[8])
-		if (inode->i_zone[8] = new_block(inode->i_dev))
+		if (inode->i_zone[8] = bmap_new(inode, nr, create))
 		{
 			inode->i_dirt = 1;
 			inode->i_ctime = CURRENT_TIME;
@@ -135,11 +276,11 @@ static int _bmap(struct m_inode *inode, int block, int create)
 		return 0;
 	if (!(bh = bread(inode->i_dev, inode->i_zone[8])))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block >> 9]; //移位操作9 = 512     10 = 1024
+	i = ((unsigned short *)bh->b_data)[block >> ADDR_BITS(inode)]; //移位操作9 = 512     10 = 1024
 	if (create && !i)
-		if (i = new_block(inode->i_dev))
+		if (i = bmap_new(inode, nr, create))
 		{
-			((unsigned short *)(bh->b_data))[block >> 9] = i;
+			((unsigned short *)(bh->b_data))[block >> ADDR_BITS(inode)] = i;
 			bh->b_dirt = 1;
 		}
 	brelse(bh);
@@ -147,20 +288,124 @@ static int _bmap(struct m_inode *inode, int block, int create)
 		return 0;
 	if (!(bh = bread(inode->i_dev, i)))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block & 511]; //找一级间接块上的偏移
+	block &= ADDR_PER_BLOCK(inode) - 1;
+	i = ((unsigned short *)bh->b_data)[block]; //找一级间接块上的偏移
 	if (create && !i)
-		if (i = new_block(inode->i_dev))
+		if (i = bmap_new(inode, nr, create))
 		{
-			((unsigned short *)(bh->b_data))[block & 511] = i;
+			((unsigned short *)(bh->b_data))[block] = i;
 			bh->b_dirt = 1;
 		}
 	brelse(bh);
 	return i;
 }
 
+/*
+ * The zone of the indirect block that maps 'block' (which is past the
+ * direct ones), or 0. For the double indirect part this needs an entry
+ * of the double indirect block: the last one looked up is kept in the
+ * inode, and the block itself in *dbh while bmap_range() goes on.
+ */
+static int ind_zone(struct m_inode *inode, int block, struct buffer_head **dbh)
+{
+	int i, zone;
+
+	if (block < 7 + ADDR_PER_BLOCK(inode))
+		return inode->i_zone[7];
+	i = (block - 7 - ADDR_PER_BLOCK(inode)) >> ADDR_BITS(inode);
+	if (inode->i_dind_index == i + 1)
+		return inode->i_dind_zone;
+	if (!inode->i_zone[8])
+		return 0;
+	if (!*dbh && !(*dbh = bread(inode->i_dev, inode->i_zone[8])))
+		return 0;
+	if (zone = ((unsigned short *)(*dbh)->b_data)[i])
+	{
+		inode->i_dind_index = i + 1;
+		inode->i_dind_zone = zone;
+	}
+	return zone;
+}
+
+/*
+ * Map 'count' blocks of a file, from 'block' on, into zones[] (0 for a
+ * hole), reading each indirect block only once. Returns the number of
+ * blocks done, which is less than count only past the largest file.
+ */
+int bmap_range(struct m_inode *inode, int block, int *zones, int count)
+{
+	struct buffer_head *bh = NULL, *dbh = NULL;
+	int n, zone, ind = 0;
+
+	if (block < 0)
+		panic("bmap_range: block<0");
+	for (n = 0; n < count; n++, block++)
+	{
+		if (block < 7)
+		{
+			zones[n] = inode->i_zone[block];
+			continue;
+		}
+		if (block >= MAX_FILE_BLOCKS(inode))
+			break;
+		if (!(zone = ind_zone(inode, block, &dbh)))
+		{
+			zones[n] = 0;
+			continue;
+		}
+		if (zone != ind)
+		{
+			brelse(bh);
+			if (!(bh = bread(inode->i_dev, ind = zone)))
+			{
+				ind = 0;
+				zones[n] = 0;
+				continue;
+			}
+		}
+		zones[n] = ((unsigned short *)bh->b_data)
+			[(block - 7) & (ADDR_PER_BLOCK(inode) - 1)];
+	}
+	brelse(bh);
+	brelse(dbh);
+	return n;
+}
+
+/*
+ * bmap() remembers the run of zones following the one it looked up, as
+ * far as they are contiguous and in the same indirect block, so that a
+ * file read in order only looks at its indirect blocks now and then.
+ */
+#define BMAP_BATCH 16
+
 int bmap(struct m_inode *inode, int block)
 {
-	return _bmap(inode, block, 0);
+	int zones[BMAP_BATCH];
+	int i, n;
+
+	if (block < 0)
+		panic("_bmap: block<0");
+	if (block >= MAX_FILE_BLOCKS(inode))
+		panic("_bmap: block>big");
+	if ((unsigned long)block - inode->i_run_block < inode->i_run_len)
+	{
+		nr_bmap_hits++;
+		return inode->i_run_zone + (block - inode->i_run_block);
+	}
+	if (block < 7)
+		return inode->i_zone[block];
+	nr_bmap_lookups++;
+	n = ADDR_PER_BLOCK(inode) - ((block - 7) & (ADDR_PER_BLOCK(inode) - 1));
+	if (n > BMAP_BATCH)
+		n = BMAP_BATCH;
+	if (!bmap_range(inode, block, zones, n) || !zones[0])
+		return 0;
+	for (i = 1; i < n && zones[i] == zones[0] + i; i++)
+		;
+	inode->i_run_block = block;
+	inode->i_run_zone = zones[0];
+	inode->i_run_len = i;
+	return zones[0];
 }
 
 int create_block(struct m_inode *inode, int block)
@@ -168,6 +413,196 @@ int create_block(struct m_inode *inode, int block)
 	return _bmap(inode, block, 1);
 }
 
+/*
+ * Delayed allocation. When a regular file is written where it has no
+ * block yet, no zone is allocated: the data waits in a buffer of its
+ * own (see get_unhashed_buffer()) on the inode's i_delayed list, sorted
+ * by block, with b_blocknr the block in the file. flush_delayed() gives
+ * them zones when the write-back gets to the file, all at once and in
+ * order, so they end up next to each other. A file that is removed
+ * before that never touches the bitmaps.
+ *
+ * Each waiting block holds a zone of s_reserved, and an inode with any
+ * holds DELAY_META more for the indirect blocks, so that the flush
+ * can't run out of space. The list holds a reference to each buffer.
+ */
+#define DELAY_MAX 64		/* blocks waiting per inode */
+#define DELAY_META 3
+#define DELAY_AGE (5 * HZ)
+#define too_many_delayed() (nr_delayed * 4 > NR_BUFFERS)
+
+static struct buffer_head *find_delayed(struct m_inode *inode, int block)
+{
+	struct buffer_head *bh;
+
+	for (bh = inode->i_delayed; bh; bh = bh->b_delay_next)
+		if (bh->b_blocknr == block)
+			return bh;
+	return NULL;
+}
+
+static void remove_delayed(struct m_inode *inode, struct buffer_head *bh,
+						   struct super_block *sb)
+{
+	struct buffer_head **p;
+
+	for (p = &inode->i_delayed; *p != bh; p = &(*p)->b_delay_next)
+		if (!*p)
+			panic("remove_delayed: not on the list");
+	*p = bh->b_delay_next;
+	bh->b_delay_next = NULL;
+	nr_delayed--;
+	inode->i_nr_delayed--;
+	if (sb)
+		sb->s_reserved -= inode->i_delayed ? 1 : 1 + DELAY_META;
+	bh->b_uptodate = 0;
+	brelse(bh);
+}
+
+/*
+ * Returns the delayed buffer for a block of the file, with a reference
+ * for the caller. With 'create' one is set up if the block has nowhere
+ * to go yet, unless there are too many already: NULL then means "do it
+ * the old way". NO_DELAY_SPACE means there is no space to reserve, and
+ * the old way mustn't be tried either, it would eat into the reserve.
+ */
+struct buffer_head *get_delayed(struct m_inode *inode, int block, int create)
+{
+	struct super_block *sb;
+	struct buffer_head *bh, **p;
+	int need;
+
+repeat:
+	if (bh = find_delayed(inode, block))
+	{
+		bh->b_count++;
+		return bh;
+	}
+	if (!create || !S_ISREG(inode->i_mode) || bmap(inode, block))
+		return NULL;
+	if (inode->i_nr_delayed >= DELAY_MAX || too_many_delayed())
+	{
+		flush_delayed(inode);
+		if (inode->i_nr_delayed || too_many_delayed())
+			return NULL;
+		goto repeat;
+	}
+	if (!(sb = get_super(inode->i_dev)))
+		return NULL;
+	bh = get_unhashed_buffer(I_BLOCK_SIZE(inode));
+/* we may have slept: look again, the last look mustn't sleep */
+	if (bmap(inode, block) || find_delayed(inode, block))
+	{
+		brelse(bh);
+		goto repeat;
+	}
+	need = inode->i_delayed ? 1 : 1 + DELAY_META;
+	if (sb->s_free_zones < sb->s_reserved + need)
+	{
+		brelse(bh);
+		return NO_DELAY_SPACE;
+	}
+	sb->s_reserved += need;
+	memset(bh->b_data, 0, bh->b_size);
+	bh->b_uptodate = 1;
+	bh->b_blocknr = block;
+	bh->b_count++;
+	for (p = &inode->i_delayed; *p && (*p)->b_blocknr < block;
+		 p = &(*p)->b_delay_next)
+		;
+	if (!inode->i_delayed)
+		inode->i_delay_time = jiffies;
+	bh->b_delay_next = *p;
+	*p = bh;
+	inode->i_nr_delayed++;
+	nr_delayed++;
+	return bh;
+}
+
+/*
+ * Give the delayed blocks of an inode their zones, and move the data to
+ * ordinary buffers for the write-back. A block somebody is copying in
+ * or out of right now (b_count > 1) is left for the next time. The inode
+ * is locked, so that two of us don't do the same file at once.
+ */
+void flush_delayed(struct m_inode *inode)
+{
+	struct super_block *sb;
+	struct buffer_head *bh, *bh2;
+	int nr;
+
+	if (!inode->i_delayed)
+		return;
+	lock_inode(inode);
+	while (1)
+	{
+		for (bh = inode->i_delayed; bh && bh->b_count > 1; bh = bh->b_delay_next)
+			;
+		if (!bh)
+			break;
+		if (!(sb = get_super(inode->i_dev)))
+		{
+			printk("flush_delayed: no super block on %04x\n\r", inode->i_dev);
+			discard_delayed(inode);
+			break;
+		}
+		bh->b_count++; /* keep it while we sleep */
+		nr = _bmap(inode, bh->b_blocknr, 2);
+		bh2 = nr ? getblk(inode->i_dev, nr) : NULL;
+		if (--bh->b_count > 1 && bh2)
+		{
+			brelse(bh2);
+			continue;
+		}
+		if (bh2)
+		{
+			memcpy(bh2->b_data, bh->b_data, bh->b_size);
+			bh2->b_uptodate = 1;
+			bh2->b_dirt = 1;
+			nr_delay_flushed++;
+		}
+		else
+			printk("flush_delayed: no space on %04x, block lost\n\r",
+				   inode->i_dev);
+		remove_delayed(inode, bh, sb);
+		brelse(bh2);
+	}
+	unlock_inode(inode);
+}
+
+/* the file is being truncated or removed: the data can just go */
+void discard_delayed(struct m_inode *inode)
+{
+	struct super_block *sb;
+
+	if (!inode->i_delayed)
+		return;
+	sb = get_super(inode->i_dev);
+	while (inode->i_delayed)
+	{
+		nr_delay_discarded++;
+		remove_delayed(inode, inode->i_delayed, sb);
+	}
+}
+
+/*
+ * Called by the write-back: only blocks that have waited DELAY_AGE are
+ * due, unless 'force' is set. dev 0 means every device.
+ */
+void sync_delayed(int dev, int force)
+{
+	struct m_inode *inode;
+	int i;
+
+	if (!nr_delayed)
+		return;
+	inode = 0 + inode_table;
+	for (i = 0; i < NR_INODE; i++, inode++)
+		if (inode->i_delayed && (!dev || inode->i_dev == dev) &&
+			(force || jiffies - inode->i_delay_time >= DELAY_AGE))
+			flush_delayed(inode);
+}
+
 //主要是对i_count引用次数进行操作，把i节点引用数值减1
 //并且若是管道i节点，则唤醒等待进程
 //若是块设备文件i节点则刷新设备
@@ -185,15 +620,17 @@ void iput(struct m_inode *inode)
 		wake_up(&inode->i_wait);
 		if (--inode->i_count)
 			return;
-		free_page(inode->i_size);
+		free_pipe_pages(inode);
 		inode->i_count = 0;
 		inode->i_dirt = 0;
 		inode->i_pipe = 0;
+		put_unused_inode(inode);
 		return;
 	}
 	if (!inode->i_dev)
 	{
-		inode->i_count--;
+		if (!--inode->i_count)
+			put_unused_inode(inode);
 		return;
 	}
 	if (S_ISBLK(inode->i_mode)) //判断是否是块设备
@@ -207,6 +644,11 @@ repeat:
 		inode->i_count--;
 		return;
 	}
+	if (inode->i_prealloc_count)
+	{
+		free_prealloc(inode); /* we can sleep - so do again */
+		goto repeat;
+	}
 	if (!inode->i_nlinks)
 	{
 		truncate(inode);
@@ -220,43 +662,55 @@ repeat:
 		goto repeat;
 	}
 	inode->i_count--;
+	put_unused_inode(inode);
 	return;
 }
 
+/*
+ * Take the least recently used unused inode, but look a little further
+ * down the list for one that can be had without writing it out first.
+ */
+#define IFREE_PROBES 16
+
 struct m_inode *get_empty_inode(void)
 {
-	struct m_inode *inode;
-	static struct m_inode *last_inode = inode_table;
+	struct m_inode *inode, *tmp;
 	int i;
 
 	do
 	{
-		inode = NULL;
-		for (i = NR_INODE; i; i--)
-		{
-			if (++last_inode >= inode_table + NR_INODE) //如果用完了就从第一个开始用 就等于第一个
-				last_inode = inode_table;
-			if (!last_inode->i_count) //如果此inode节点的引用为0就证明没用就用这个
-			{
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock) //没有未回写的数据 没有被锁定
-					break;
-			}
-		}
-		if (!inode)
+		if (!(inode = free_inodes))
 		{
 			for (i = 0; i < NR_INODE; i++)
 				printk("%04x: %6d\t", inode_table[i].i_dev,
 					   inode_table[i].i_num);
 			panic("No free inodes in mem");
 		}
+		for (i = 0, tmp = inode; i < IFREE_PROBES; i++)
+		{
+			if (!tmp->i_dirt && !tmp->i_lock && !tmp->i_delayed) //没有未回写的数据 没有被锁定
+			{
+				inode = tmp;
+				break;
+			}
+			if ((tmp = tmp->i_free_next) == free_inodes)
+				break;
+		}
 		wait_on_inode(inode);
+		if (inode->i_delayed)
+		{
+			flush_delayed(inode);
+			continue;
+		}
 		while (inode->i_dirt)
 		{
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
-	} while (inode->i_count);
+	} while (inode->i_count || inode->i_delayed);
+	remove_unused_inode(inode);
+	remove_inode_hash(inode);
+	free_text_pages(inode);
 	memset(inode, 0, sizeof(*inode));
 	inode->i_count = 1;
 	return inode;
@@ -265,16 +719,20 @@ struct m_inode *get_empty_inode(void)
 struct m_inode *get_pipe_inode(void)
 {
 	struct m_inode *inode;
+	unsigned long page;
 
 	if (!(inode = get_empty_inode()))
 		return NULL;
-	if (!(inode->i_size = get_free_page()))
+	if (!(page = get_free_page()))
 	{
 		inode->i_count = 0;
+		put_unused_inode(inode);
 		return NULL;
 	}
 	//这个节点要有2个进程操作 1读 1写
 	inode->i_count = 2; /* sum of readers/writers */
+	inode->i_zone[2] = page >> 12;
+	PIPE_LEN(*inode) = PAGE_SIZE;
 	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
 	inode->i_pipe = 1;
 	return inode;
@@ -287,21 +745,21 @@ struct m_inode *iget(int dev, int nr)
 	if (!dev)
 		panic("iget with dev==0");
 	empty = get_empty_inode();
-	inode = inode_table;
-	while (inode < NR_INODE + inode_table)
+repeat:
+	for (inode = ihash(dev, nr); inode; inode = inode->i_hash_next)
+	{
+		nr_iget_probes++;
+		if (inode->i_dev == dev && inode->i_num == nr)
+			break;
+	}
+	if (inode)
 	{
-		if (inode->i_dev != dev || inode->i_num != nr)
-		{
-			inode++;
-			continue;
-		}
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) //不知道出了什么问题重新执行一次
-		{
-			inode = inode_table;
-			continue;
-		}
-		inode->i_count++;
+		if (inode->i_dev != dev || inode->i_num != nr) //睡眠期间被换掉了 重新查找
+			goto repeat;
+		if (!inode->i_count++)
+			remove_unused_inode(inode);
+		nr_iget_hits++;
 		if (inode->i_mount)
 		{
 			int i;
@@ -319,8 +777,7 @@ struct m_inode *iget(int dev, int nr)
 			iput(inode);
 			dev = super_block[i].s_dev;
 			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+			goto repeat;
 		}
 		if (empty)
 			iput(empty);
@@ -328,14 +785,15 @@ struct m_inode *iget(int dev, int nr)
 	}
 	if (!empty)
 		return (NULL);
+	nr_iget_misses++;
 	inode = empty;
 	inode->i_dev = dev;
 	inode->i_num = nr;
+	insert_inode_hash(inode);
 	read_inode(inode);
 	return inode;
 }
 
-// read_inode读出来的inode节点是不包含inode内存动态信息的
 static void read_inode(struct m_inode *inode)
 {
 	struct super_block *sb;
@@ -345,13 +803,14 @@ static void read_inode(struct m_inode *inode)
 	lock_inode(inode);
 	if (!(sb = get_super(inode->i_dev)))
 		panic("trying to read inode without dev");
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-			(inode->i_num - 1) / INODES_PER_BLOCK;
+	block = FIRST_MAP_BLOCK(sb) + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num - 1) / INODES_PER_BLOCK(sb);
 	if (!(bh = bread(inode->i_dev, block)))
 		panic("unable to read i-node block");
 	*(struct d_inode *)inode =
 		((struct d_inode *)bh->b_data)
-			[(inode->i_num - 1) % INODES_PER_BLOCK]; //一个block 有好几个节点 要读此块上的第几个节点
+			[(inode->i_num - 1) % INODES_PER_BLOCK(sb)]; //一个block 有好几个节点 要读此块上的第几个节点
+	inode->i_blkbits = sb->s_blocksize_bits;
 	brelse(bh);
 	unlock_inode(inode);
 }
@@ -371,12 +830,12 @@ static void write_inode(struct m_inode *inode)
 	if (!(sb = get_super(inode->i_dev)))
 		panic("trying to write inode without device");
 	//计算当前inode节点的逻辑块号
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-			(inode->i_num - 1) / INODES_PER_BLOCK;
+	block = FIRST_MAP_BLOCK(sb) + sb->s_imap_blocks + sb->s_zmap_blocks +
+			(inode->i_num - 1) / INODES_PER_BLOCK(sb);
 	if (!(bh = bread(inode->i_dev, block)))
 		panic("unable to read i-node block");
 	((struct d_inode *)bh->b_data)
-		[(inode->i_num - 1) % INODES_PER_BLOCK] =
+		[(inode->i_num - 1) % INODES_PER_BLOCK(sb)] =
 			*(struct d_inode *)inode;
 	bh->b_dirt = 1;
 	inode->i_dirt = 0;
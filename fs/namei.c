@@ -11,6 +11,7 @@
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/dir_index.h>
 #include <asm/segment.h>
 
 #include <string.h>
@@ -82,6 +83,70 @@ static int match(int len, const char *name, struct dir_entry *de)
 	return same;
 }
 
+/*
+ * get_dir_index() returns the index header of a directory, given the
+ * buffer of its first block, or NULL if it has none (or a stale one).
+ * See <linux/dir_index.h> for the layout.
+ */
+static struct dir_index *get_dir_index(struct m_inode *dir, struct buffer_head *bh)
+{
+	struct dir_index *di = DIR_INDEX_SLOT + (struct dir_index *)bh->b_data;
+
+	if (di->inode || di->magic != DIR_INDEX_MAGIC || !di->nbuckets)
+		return NULL;
+	if ((di->nbuckets + 1) * I_BLOCK_SIZE(dir) > dir->i_size)
+		return NULL;
+	if (di->mtime != dir->i_mtime || di->size != dir->i_size)
+		return NULL;
+	return di;
+}
+
+/*
+ * Changing the mtime of a directory would make its index look stale, so
+ * rmdir(), unlink() and utime() go through here: the header is moved on
+ * with it, if it was valid. add_entry() does the same by itself.
+ */
+void set_dir_mtime(struct m_inode *dir, long mtime)
+{
+	struct buffer_head *bh;
+	struct dir_index *di;
+
+	if (dir->i_zone[0] && (bh = bread(dir->i_dev, dir->i_zone[0])))
+	{
+		if ((di = get_dir_index(dir, bh)) != NULL)
+		{
+			di->mtime = mtime;
+			bh->b_dirt = 1;
+		}
+		brelse(bh);
+	}
+	dir->i_mtime = mtime;
+	dir->i_dirt = 1;
+}
+
+/* the directory block (not zone) a user-space name belongs in */
+static int index_block(struct dir_index *di, const char *name, int namelen)
+{
+	char buf[NAME_LEN];
+	int i;
+
+	for (i = 0; i < namelen; i++)
+		buf[i] = get_fs_byte(name + i);
+	return dir_index_block(di, buf, namelen);
+}
+
+static struct dir_entry *search_block(struct buffer_head *bh,
+									  const char *name, int namelen)
+{
+	struct dir_entry *de = (struct dir_entry *)bh->b_data;
+	int i;
+
+	for (i = 0; i < bh->b_size / sizeof(struct dir_entry); i++, de++)
+		if (match(namelen, name, de))
+			return de;
+	return NULL;
+}
+
 /*
  *	find_entry()
  *
@@ -104,6 +169,8 @@ static struct buffer_head *find_entry(struct m_inode **dir,
 	struct buffer_head *bh;
 	struct dir_entry *de;
 	struct super_block *sb;
+	struct dir_index *di;
+	int overflow;
 
 #ifdef NO_TRUNCATE
 	if (namelen > NAME_LEN)
@@ -144,21 +211,40 @@ static struct buffer_head *find_entry(struct m_inode **dir,
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev, block))) //读取这个块号对应的缓冲区头结构体
 		return NULL;
+/* an indexed directory: look in block 0 and the name's bucket only */
+	if ((di = get_dir_index(*dir, bh)) != NULL)
+	{
+		i = index_block(di, name, namelen);
+		overflow = di->flags & DIR_INDEX_OVERFLOW;
+		if ((*res_dir = search_block(bh, name, namelen)) != NULL)
+			return bh;
+		brelse(bh);
+		if ((block = bmap(*dir, i)) && (bh = bread((*dir)->i_dev, block)))
+		{
+			if ((*res_dir = search_block(bh, name, namelen)) != NULL)
+				return bh;
+			brelse(bh);
+		}
+		if (!overflow)
+			return NULL;
+		if (!(bh = bread((*dir)->i_dev, (*dir)->i_zone[0])))
+			return NULL;
+	}
 	i = 0;								 // i是目录中目录索引号，初始化为0
 	de = (struct dir_entry *)bh->b_data; // de专项缓冲区中的数据部分
 	while (i < entries)					 //在不超过目录中目录项数的条件下，进行循环搜索
 	{
 		//如果当前目录项数据已经搜索完毕，还没有找到匹配的目录项
-		if ((char *)de >= BLOCK_SIZE + bh->b_data)
+		if ((char *)de >= bh->b_size + bh->b_data)
 		{
 			brelse(bh); //释放当前目录块的高速缓冲区
 			bh = NULL;
 			//在读取目录的下一项对应的逻辑块号 并 读取这个块对应的高速缓冲区头
 			//因为一个文件对应的inode节点的数据都是存在在连续的block上的
-			if (!(block = bmap(*dir, i / DIR_ENTRIES_PER_BLOCK)) ||
+			if (!(block = bmap(*dir, i / DIR_ENTRIES_PER_BLOCK(*dir))) ||
 				!(bh = bread((*dir)->i_dev, block)))
 			{
-				i += DIR_ENTRIES_PER_BLOCK;
+				i += DIR_ENTRIES_PER_BLOCK(*dir);
 				continue;
 			}
 			// de再次指向新的数据部分
@@ -192,9 +278,10 @@ static struct buffer_head *find_entry(struct m_inode **dir,
 static struct buffer_head *add_entry(struct m_inode *dir,
 									 const char *name, int namelen, struct dir_entry **res_dir)
 {
-	int block, i;
-	struct buffer_head *bh;
+	int block, i, nr = 0;
+	struct buffer_head *bh, *ibh = NULL;
 	struct dir_entry *de;
+	struct dir_index *di;
 
 	*res_dir = NULL;
 #ifdef NO_TRUNCATE
@@ -210,20 +297,46 @@ static struct buffer_head *add_entry(struct m_inode *dir,
 		return NULL;
 	if (!(bh = bread(dir->i_dev, block)))
 		return NULL;
+/*
+ * Indexed directory: try the bucket first. Block 0 stays locked in
+ * the cache (ibh) so that the header can be updated at the end.
+ */
+	if ((di = get_dir_index(dir, bh)) != NULL)
+	{
+		ibh = bh;
+		nr = index_block(di, name, namelen);
+		if ((block = bmap(dir, nr)) && (bh = bread(dir->i_dev, block)))
+		{
+			i = nr * DIR_ENTRIES_PER_BLOCK(dir);
+			de = (struct dir_entry *)bh->b_data;
+			for (; (char *)de < bh->b_size + bh->b_data; de++, i++)
+				if (!de->inode)
+					goto found;
+			brelse(bh);
+		}
+		if (!(bh = bread(dir->i_dev, dir->i_zone[0])))
+		{
+			brelse(ibh);
+			return NULL;
+		}
+	}
 	i = 0;
 	de = (struct dir_entry *)bh->b_data;
 	while (1)
 	{
-		if ((char *)de >= BLOCK_SIZE + bh->b_data)
+		if ((char *)de >= bh->b_size + bh->b_data)
 		{
 			brelse(bh);
 			bh = NULL;
-			block = create_block(dir, i / DIR_ENTRIES_PER_BLOCK);
+			block = create_block(dir, i / DIR_ENTRIES_PER_BLOCK(dir));
 			if (!block)
+			{
+				brelse(ibh);
 				return NULL;
+			}
 			if (!(bh = bread(dir->i_dev, block)))
 			{
-				i += DIR_ENTRIES_PER_BLOCK;
+				i += DIR_ENTRIES_PER_BLOCK(dir);
 				continue;
 			}
 			de = (struct dir_entry *)bh->b_data;
@@ -235,20 +348,78 @@ static struct buffer_head *add_entry(struct m_inode *dir,
 			dir->i_dirt = 1;
 			dir->i_ctime = CURRENT_TIME;
 		}
-		if (!de->inode)
-		{ //找到一个空的i节点然后写入进去
-			dir->i_mtime = CURRENT_TIME;
-			for (i = 0; i < NAME_LEN; i++)
-				de->name[i] = (i < namelen) ? get_fs_byte(name + i) : 0;
-			bh->b_dirt = 1;
-			*res_dir = de;
-			return bh;
-		}
+		if (!de->inode && !(ibh && i == DIR_INDEX_SLOT))
+			break; //找到一个空的i节点然后写入进去
 		de++;
 		i++;
 	}
+found:
+	dir->i_mtime = CURRENT_TIME;
+/*
+ * Keep the index valid. We might have slept since get_dir_index(), so
+ * check that nobody has taken the header slot meanwhile.
+ */
+	if (ibh)
+	{
+		if (!di->inode && di->magic == DIR_INDEX_MAGIC)
+		{
+			if ((i / DIR_ENTRIES_PER_BLOCK(dir)) && (i / DIR_ENTRIES_PER_BLOCK(dir)) != nr)
+				di->flags |= DIR_INDEX_OVERFLOW;
+			di->mtime = dir->i_mtime;
+			di->size = dir->i_size;
+			ibh->b_dirt = 1;
+		}
+		brelse(ibh);
+	}
+	for (i = 0; i < NAME_LEN; i++)
+		de->name[i] = (i < namelen) ? get_fs_byte(name + i) : 0;
+	dcache_remove(dir->i_dev, dir->i_num, de->name, namelen);
+	bh->b_dirt = 1;
+	*res_dir = de;
+	return bh;
+}
+
+/*
+ *	lookup()
+ *
+ * gives the inode number of a name in a directory, or 0 if there is no
+ * such name. It goes through the name cache (fs/dcache.c) and only calls
+ * find_entry() if the name isn't cached. '.' and '..' always go to
+ * find_entry(), as it has to do its mount-point magic for '..' - this is
+ * also why *dir may change, just like with find_entry().
+ */
+static int lookup(struct m_inode **dir, const char *name, int namelen)
+{
+	char buf[NAME_LEN];
+	struct buffer_head *bh;
+	struct dir_entry *de;
+	unsigned long version;
+	int i, inr, cache;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return 0;
+#else
+	if (namelen > NAME_LEN)
+		namelen = NAME_LEN;
+#endif
+	for (i = 0; i < namelen; i++)
+		buf[i] = get_fs_byte(name + i);
+	cache = namelen && !(buf[0] == '.' &&
+						 (namelen == 1 || (namelen == 2 && buf[1] == '.')));
+	if (cache)
+	{
+		inr = dcache_lookup((*dir)->i_dev, (*dir)->i_num, buf, namelen);
+		if (inr >= 0)
+			return inr;
+	}
+	version = dcache_version;
+	bh = find_entry(dir, name, namelen, &de);
+	inr = bh ? de->inode : 0;
 	brelse(bh);
-	return NULL;
+	if (cache && version == dcache_version)
+		dcache_add((*dir)->i_dev, (*dir)->i_num, buf, namelen, inr);
+	return inr;
 }
 
 /*
@@ -264,9 +435,7 @@ static struct m_inode *get_dir(const char *pathname)
 	char c;
 	const char *thisname;
 	struct m_inode *inode;
-	struct buffer_head *bh;
 	int namelen, inr, idev;
-	struct dir_entry *de;
 
 	if (!current->root || !current->root->i_count)
 		panic("No root inode");
@@ -294,14 +463,12 @@ static struct m_inode *get_dir(const char *pathname)
 			/* nothing */;
 		if (!c)
 			return inode;
-		if (!(bh = find_entry(&inode, thisname, namelen, &de)))
+		if (!(inr = lookup(&inode, thisname, namelen)))
 		{
 			iput(inode);
 			return NULL;
 		}
-		inr = de->inode;
 		idev = inode->i_dev;
-		brelse(bh);
 		iput(inode);
 		if (!(inode = iget(idev, inr)))
 			return NULL;
@@ -346,22 +513,17 @@ struct m_inode *namei(const char *pathname)
 	const char *basename;
 	int inr, dev, namelen;
 	struct m_inode *dir;
-	struct buffer_head *bh;
-	struct dir_entry *de;
 
 	if (!(dir = dir_namei(pathname, &namelen, &basename)))
 		return NULL;
 	if (!namelen) /* special case: '/usr/' etc */
 		return dir;
-	bh = find_entry(&dir, basename, namelen, &de);
-	if (!bh)
+	if (!(inr = lookup(&dir, basename, namelen)))
 	{
 		iput(dir);
 		return NULL;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	dir = iget(dev, inr);
 	if (dir)
@@ -554,7 +716,7 @@ int sys_mkdir(const char *pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0] = new_block(inode->i_dev)))
+	if (!(inode->i_zone[0] = new_block(inode->i_dev, 0)))
 	{
 		iput(dir);
 		inode->i_nlinks--;
@@ -628,13 +790,13 @@ static int empty_dir(struct m_inode *inode)
 	de += 2;
 	while (nr < len)
 	{
-		if ((void *)de >= (void *)(bh->b_data + BLOCK_SIZE))
+		if ((void *)de >= (void *)(bh->b_data + bh->b_size))
 		{
 			brelse(bh);
-			block = bmap(inode, nr / DIR_ENTRIES_PER_BLOCK);
+			block = bmap(inode, nr / DIR_ENTRIES_PER_BLOCK(inode));
 			if (!block)
 			{
-				nr += DIR_ENTRIES_PER_BLOCK;
+				nr += DIR_ENTRIES_PER_BLOCK(inode);
 				continue;
 			}
 			if (!(bh = bread(inode->i_dev, block)))
@@ -726,13 +888,15 @@ int sys_rmdir(const char *name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)", inode->i_nlinks);
 	de->inode = 0;
+	dcache_remove(dir->i_dev, dir->i_num, de->name, namelen);
+	dcache_invalidate_dir(inode->i_dev, inode->i_num);
 	bh->b_dirt = 1;
 	brelse(bh);
 	inode->i_nlinks = 0;
 	inode->i_dirt = 1;
 	dir->i_nlinks--;
-	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
-	dir->i_dirt = 1;
+	dir->i_ctime = CURRENT_TIME;
+	set_dir_mtime(dir, CURRENT_TIME);
 	iput(dir);
 	iput(inode);
 	return 0;
@@ -793,11 +957,14 @@ int sys_unlink(const char *name)
 		inode->i_nlinks = 1;
 	}
 	de->inode = 0;
+	dcache_remove(dir->i_dev, dir->i_num, de->name, namelen);
 	bh->b_dirt = 1;
 	brelse(bh);
 	inode->i_nlinks--;
 	inode->i_dirt = 1;
 	inode->i_ctime = CURRENT_TIME;
+	dir->i_ctime = CURRENT_TIME;
+	set_dir_mtime(dir, CURRENT_TIME);
 	iput(inode);
 	iput(dir);
 	return 0;
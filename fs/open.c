@@ -16,9 +16,20 @@
 #include <linux/kernel.h>
 #include <asm/segment.h>
 
+/* the free counts are kept up to date in bitmap.c, so this is cheap */
 int sys_ustat(int dev, struct ustat *ubuf)
 {
-	return -ENOSYS;
+	struct super_block *sb;
+	struct ustat tmp;
+
+	if (!(sb = get_super(dev)))
+		return -EINVAL;
+	verify_area(ubuf, sizeof(*ubuf));
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.f_tfree = sb->s_free_zones;
+	tmp.f_tinode = sb->s_free_inodes;
+	memcpy_tofs(ubuf, &tmp, sizeof(tmp));
+	return 0;
 }
 
 int sys_utime(char *filename, struct utimbuf *times)
@@ -36,7 +47,10 @@ int sys_utime(char *filename, struct utimbuf *times)
 	else
 		actime = modtime = CURRENT_TIME;
 	inode->i_atime = actime;
-	inode->i_mtime = modtime;
+	if (S_ISDIR(inode->i_mode))
+		set_dir_mtime(inode, modtime); /* keeps a directory index valid */
+	else
+		inode->i_mtime = modtime;
 	inode->i_dirt = 1;
 	iput(inode);
 	return 0;
@@ -193,6 +207,8 @@ int sys_open(const char *filename, int flag, int mode)
 	f->f_count = 1;
 	f->f_inode = inode;
 	f->f_pos = 0;
+	f->f_ranext = f->f_raend = 0;
+	f->f_rawin = 0;
 	return (fd);
 }
 
@@ -5,69 +5,226 @@
  */
 
 #include <signal.h>
+#include <errno.h>
+#include <string.h>
 
 #include <linux/sched.h>
+#include <linux/kernel.h>
 #include <linux/mm.h>	/* for get_free_page */
 #include <asm/segment.h>
+#include <asm/system.h>
+
+/*
+ * Readers and writers sleep on the same inode->i_wait. Rather than waking
+ * the other side for every chunk copied, a reader only wakes up writers
+ * when the free space grows past the watermark, and a writer wakes up
+ * readers when the data grows past it and once it is done. Nobody sleeps
+ * unless the pipe is completely empty/full, so this can't lose a wakeup.
+ */
+#define PIPE_WATERMARK(inode) (PIPE_LEN(inode)/2)
+
+static unsigned long pipe_read_bytes = 0;
+static unsigned long pipe_write_bytes = 0;
+static unsigned long pipe_sleeps = 0;
+static unsigned long pipe_wakeups = 0;
+
+static inline void pipe_wake(struct m_inode * inode)
+{
+	if (inode->i_wait) {
+		pipe_wakeups++;
+		wake_up(&inode->i_wait);
+	}
+}
+
+/*
+ * memcpy_tofs/fromfs can fault and sleep half-way through a chunk, so the
+ * ring is locked while it is being copied: otherwise set_pipe_size() could
+ * free the page under us, or a second reader take the same bytes.
+ *
+ * Whoever waits for the lock sets i_lock to 2 (so does wait_on_inode()),
+ * and only then does unlocking wake up i_wait: the other side sleeps
+ * there too, and mustn't be woken for every chunk.
+ */
+static inline void lock_pipe(struct m_inode * inode)
+{
+	cli();
+	while (inode->i_lock) {
+		inode->i_lock = 2;
+		sleep_on(&inode->i_wait);
+	}
+	inode->i_lock = 1;
+	sti();
+}
+
+static inline void unlock_pipe(struct m_inode * inode)
+{
+	int wanted = inode->i_lock == 2;
+
+	inode->i_lock = 0;
+	if (wanted)
+		wake_up(&inode->i_wait);
+}
 
 int read_pipe(struct m_inode * inode, char * buf, int count)
 {
 	int chars, size, read = 0;
+	unsigned long tail, free;
 
 	while (count>0) {
+		lock_pipe(inode);
 		while (!(size=PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+			unlock_pipe(inode);
+			pipe_wake(inode);
 			if (inode->i_count != 2) /* are there any writers? */
 				return read;
+			pipe_sleeps++;
 			sleep_on(&inode->i_wait);
+			lock_pipe(inode);
 		}
-		chars = PAGE_SIZE-PIPE_TAIL(*inode);
+		free = PIPE_LEN(*inode)-1-size;
+		tail = PIPE_TAIL(*inode);
+		chars = PAGE_SIZE-(tail & (PAGE_SIZE-1));
 		if (chars > count)
 			chars = count;
 		if (chars > size)
 			chars = size;
+		memcpy_tofs(buf,(char *)PIPE_PAGE(*inode,tail>>12)+
+			(tail & (PAGE_SIZE-1)),chars);
+		tail += chars;
+		if (tail == PIPE_LEN(*inode))
+			tail = 0;
+		PIPE_TAIL(*inode) = tail;
+		unlock_pipe(inode);
 		count -= chars;
 		read += chars;
-		size = PIPE_TAIL(*inode);
-		PIPE_TAIL(*inode) += chars;
-		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		buf += chars;
+		pipe_read_bytes += chars;
+		if (free < PIPE_WATERMARK(*inode) &&
+		    free+chars >= PIPE_WATERMARK(*inode))
+			pipe_wake(inode);
 	}
-	wake_up(&inode->i_wait);
 	return read;
 }
 	
 int write_pipe(struct m_inode * inode, char * buf, int count)
 {
-	int chars, size, written = 0;
+	int chars, free, written = 0;
+	unsigned long head, size;
 
 	while (count>0) {
-		while (!(size=(PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+		lock_pipe(inode);
+		while (!(free=(PIPE_LEN(*inode)-1)-PIPE_SIZE(*inode))) {
+			unlock_pipe(inode);
+			pipe_wake(inode);
 			if (inode->i_count != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
 				return written?written:-1;
 			}
+			pipe_sleeps++;
 			sleep_on(&inode->i_wait);
+			lock_pipe(inode);
 		}
-		chars = PAGE_SIZE-PIPE_HEAD(*inode);
+		size = PIPE_LEN(*inode)-1-free;
+		head = PIPE_HEAD(*inode);
+		chars = PAGE_SIZE-(head & (PAGE_SIZE-1));
 		if (chars > count)
 			chars = count;
-		if (chars > size)
-			chars = size;
+		if (chars > free)
+			chars = free;
+		memcpy_fromfs((char *)PIPE_PAGE(*inode,head>>12)+
+			(head & (PAGE_SIZE-1)),buf,chars);
+		head += chars;
+		if (head == PIPE_LEN(*inode))
+			head = 0;
+		PIPE_HEAD(*inode) = head;
+		unlock_pipe(inode);
 		count -= chars;
 		written += chars;
-		size = PIPE_HEAD(*inode);
-		PIPE_HEAD(*inode) += chars;
-		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		buf += chars;
+		pipe_write_bytes += chars;
+		if (size < PIPE_WATERMARK(*inode) &&
+		    size+chars >= PIPE_WATERMARK(*inode))
+			pipe_wake(inode);
 	}
-	wake_up(&inode->i_wait);
+	pipe_wake(inode);
 	return written;
 }
 
+void free_pipe_pages(struct m_inode * inode)
+{
+	int i;
+
+	for (i=0 ; i<PIPE_MAX_PAGES ; i++)
+		if (inode->i_zone[2+i]) {
+			free_page(PIPE_PAGE(*inode,i));
+			inode->i_zone[2+i] = 0;
+		}
+}
+
+/*
+ * fcntl(fd,F_SETPIPE_SZ,size): give the pipe a new ring of size bytes,
+ * rounded up to whole pages. The data still in the pipe is moved over,
+ * so it can't be made smaller than that.
+ */
+int set_pipe_size(struct m_inode * inode, unsigned long size)
+{
+	unsigned long page[PIPE_MAX_PAGES];
+	unsigned long tail;
+	int i, n, len, chars;
+
+	n = (size+PAGE_SIZE-1)/PAGE_SIZE;
+	if (!n)
+		n = 1;
+	if (n > PIPE_MAX_PAGES)
+		return -EINVAL;
+	lock_pipe(inode);
+	if (n*PAGE_SIZE == PIPE_LEN(*inode)) {
+		unlock_pipe(inode);
+		return PIPE_LEN(*inode);
+	}
+	len = PIPE_SIZE(*inode);
+	if (len > n*PAGE_SIZE-1) {
+		unlock_pipe(inode);
+		return -EBUSY;
+	}
+	for (i=0 ; i<n ; i++)
+		if (!(page[i]=get_free_page())) {
+			while (--i >= 0)
+				free_page(page[i]);
+			unlock_pipe(inode);
+			return -ENOMEM;
+		}
+	tail = PIPE_TAIL(*inode);
+	for (i=0 ; i<len ; i += chars) {
+		chars = PAGE_SIZE-(tail & (PAGE_SIZE-1));
+		if (chars > PAGE_SIZE-(i & (PAGE_SIZE-1)))
+			chars = PAGE_SIZE-(i & (PAGE_SIZE-1));
+		if (chars > len-i)
+			chars = len-i;
+		memcpy((char *)page[i>>12]+(i & (PAGE_SIZE-1)),
+			(char *)PIPE_PAGE(*inode,tail>>12)+(tail & (PAGE_SIZE-1)),
+			chars);
+		tail += chars;
+		if (tail == PIPE_LEN(*inode))
+			tail = 0;
+	}
+	free_pipe_pages(inode);
+	for (i=0 ; i<n ; i++)
+		inode->i_zone[2+i] = page[i]>>12;
+	PIPE_LEN(*inode) = n*PAGE_SIZE;
+	PIPE_HEAD(*inode) = len;
+	PIPE_TAIL(*inode) = 0;
+	unlock_pipe(inode);
+	pipe_wake(inode);	/* a writer may have room now */
+	return PIPE_LEN(*inode);
+}
+
+void show_pipe_stats(void)
+{
+	printk("pipes: %d bytes read, %d written, %d sleeps, %d wakeups\n\r",
+		pipe_read_bytes, pipe_write_bytes, pipe_sleeps, pipe_wakeups);
+}
+
 int sys_pipe(unsigned long * fildes)
 {
 	struct m_inode * inode;
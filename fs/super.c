@@ -18,12 +18,6 @@
 int sync_dev(int dev);
 void wait_for_keypress(void);
 
-/* set_bit uses setb, as gas doesn't recognize setc */
-#define set_bit(bitnr, addr) ({ \
-register int __res __asm__("ax"); \
-__asm__("bt %2,%3;setb %%al":"=a" (__res):"a" (0),"r" (bitnr),"m" (*(addr))); \
-__res; })
-
 //操作系统中有一个超级块数组
 //把需要挂在设备文件系统的super_block读到高速缓冲区中并且放到超级块数组中
 struct super_block super_block[NR_SUPER];
@@ -97,10 +91,12 @@ void put_super(int dev)
 	//先判断一下此超级块的状态 内否被卸载 锁定进行卸载操作
 	lock_super(sb);
 	sb->s_dev = 0;
+	dcache_invalidate_dev(dev);
 	for (i = 0; i < I_MAP_SLOTS; i++) //释放超级块中所有i节点位图
 		brelse(sb->s_imap[i]);
 	for (i = 0; i < Z_MAP_SLOTS; i++) //释放超级块中所有逻辑块位图
 		brelse(sb->s_zmap[i]);
+	set_blocksize(dev, BLOCK_SIZE);
 	free_super(sb);
 	return;
 }
@@ -143,18 +139,29 @@ static struct super_block *read_super(int dev)
 		*((struct d_super_block *)bh->b_data);
 	brelse(bh);
 	//检测标识码
-	if (s->s_magic != SUPER_MAGIC)
+	if (s->s_magic != SUPER_MAGIC || s->s_log_zone_size > 2 ||
+		s->s_imap_blocks > I_MAP_SLOTS || s->s_zmap_blocks > Z_MAP_SLOTS)
 	{
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
 	}
+	/* from here on the device is read in blocks of the filesystem */
+	s->s_blocksize = BLOCK_SIZE << s->s_log_zone_size;
+	s->s_blocksize_bits = BLOCK_SIZE_BITS + s->s_log_zone_size;
+	if (set_blocksize(dev, s->s_blocksize))
+	{
+		printk("Unsupported block size %d on %04x\n\r", s->s_blocksize, dev);
+		s->s_dev = 0;
+		free_super(s);
+		return NULL;
+	}
 	//清空 i节点位图 和 逻辑块 位图
 	for (i = 0; i < I_MAP_SLOTS; i++)
 		s->s_imap[i] = NULL;
 	for (i = 0; i < Z_MAP_SLOTS; i++)
 		s->s_zmap[i] = NULL;
-	block = 2;
+	block = FIRST_MAP_BLOCK(s);
 	//根据取出的超级块读取对应设备的i节点位图
 	for (i = 0; i < s->s_imap_blocks; i++)
 		if (s->s_imap[i] = bread(dev, block))
@@ -167,12 +174,13 @@ static struct super_block *read_super(int dev)
 		else
 			break;
 	//如果读出的块数不等于因该站有的块数，则说明文件系统位图有问题，释放申请的资源返回
-	if (block != 2 + s->s_imap_blocks + s->s_zmap_blocks)
+	if (block != FIRST_MAP_BLOCK(s) + s->s_imap_blocks + s->s_zmap_blocks)
 	{
 		for (i = 0; i < I_MAP_SLOTS; i++)
 			brelse(s->s_imap[i]);
 		for (i = 0; i < Z_MAP_SLOTS; i++)
 			brelse(s->s_zmap[i]);
+		set_blocksize(dev, BLOCK_SIZE);
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
@@ -180,6 +188,7 @@ static struct super_block *read_super(int dev)
 	//对于申请空闲i节点的函数来讲，如果设备上所与的i节点都被使用，则返回为0。所以0号节点不能使用，逻辑块也是如此。
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1;
+	count_free(s);
 	free_super(s);
 	return s;
 }
@@ -211,6 +220,7 @@ int sys_umount(char *dev_name)
 	for (inode = inode_table + 0; inode < inode_table + NR_INODE; inode++)
 		if (inode->i_dev == dev && inode->i_count)
 			return -EBUSY;
+	sync_delayed(dev, 1); /* this needs the super block */
 	sb->s_imount->i_mount = 0;
 	//这里为啥要释放要是 其目录下 或者跟目录下有别的文件怎么办？
 	iput(sb->s_imount);
@@ -264,6 +274,8 @@ int sys_mount(char *dev_name, char *dir_name, int rw_flag)
 		iput(dir_i);
 		return -EPERM;
 	}
+	dcache_invalidate_dev(dev);
+	dcache_invalidate_dir(dir_i->i_dev, dir_i->i_num);
 	sb->s_imount = dir_i;
 	dir_i->i_mount = 1;
 	dir_i->i_dirt = 1; /* NOTE! we don't iput(dir_i) */
@@ -272,7 +284,7 @@ int sys_mount(char *dev_name, char *dir_name, int rw_flag)
 
 void mount_root(void)
 {
-	int i, free;
+	int i;
 	struct super_block *p;
 	struct m_inode *mi;
 
@@ -299,16 +311,7 @@ void mount_root(void)
 	p->s_isup = p->s_imount = mi;
 	current->pwd = mi;
 	current->root = mi;
-	free = 0;
-	i = p->s_nzones;
-	while (--i >= 0)
-		if (!set_bit(i & 8191, p->s_zmap[i >> 13]->b_data))
-			free++;
-	printk("%d/%d free blocks\n\r", free, p->s_nzones);
-	free = 0;
-	i = p->s_ninodes + 1;
-	while (--i >= 0)
-		if (!set_bit(i & 8191, p->s_imap[i >> 13]->b_data))
-			free++;
-	printk("%d/%d free inodes\n\r", free, p->s_ninodes);
+	printk("%d/%d free blocks of %d bytes\n\r", p->s_free_zones, p->s_nzones,
+		   p->s_blocksize);
+	printk("%d/%d free inodes\n\r", p->s_free_inodes, p->s_ninodes);
 }
@@ -18,7 +18,7 @@ static void free_ind(int dev,int block)
 		return;
 	if (bh=bread(dev,block)) {
 		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
+		for (i=0;i<bh->b_size/2;i++,p++)
 			if (*p)
 				free_block(dev,*p);
 		brelse(bh);
@@ -36,7 +36,7 @@ static void free_dind(int dev,int block)
 		return;
 	if (bh=bread(dev,block)) {
 		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
+		for (i=0;i<bh->b_size/2;i++,p++)
 			if (*p)
 				free_ind(dev,*p);
 		brelse(bh);
@@ -50,6 +50,11 @@ void truncate(struct m_inode * inode)
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	free_text_pages(inode);
+	discard_delayed(inode);
+	inode->i_run_len = 0;	/* the block map cache is no good now */
+	inode->i_dind_index = 0;
+	free_prealloc(inode);
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
 			free_block(inode->i_dev,inode->i_zone[i]);
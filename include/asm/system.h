@@ -19,6 +19,12 @@ __asm__ ("movl %%esp,%%eax\n\t" \
 
 #define iret() __asm__ ("iret"::)
 
+#define save_flags(x) \
+__asm__ ("pushfl ; popl %0":"=r" (x))
+
+#define restore_flags(x) \
+__asm__ ("pushl %0 ; popfl"::"r" (x))
+
 #define _set_gate(gate_addr,type,dpl,addr) \
 __asm__ ("movw %%dx,%%ax\n\t" \
 	"movw %0,%%dx\n\t" \
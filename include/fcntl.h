@@ -28,6 +28,8 @@
 #define F_GETLK		5	/* not implemented */
 #define F_SETLK		6
 #define F_SETLKW	7
+#define F_SETPIPE_SZ	1031	/* set pipe buffer size, as in linux */
+#define F_GETPIPE_SZ	1032
 
 /* for F_[GET|SET]FL */
 #define FD_CLOEXEC	1	/* actually anything with low bit set goes */
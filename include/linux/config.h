@@ -18,6 +18,14 @@
 /*#define KBD_FR */
 #define KBD_FINNISH
 
+/*
+ * Request ordering for each block major, chosen at boot by
+ * blk_dev_init(): "elevator" (the original reads-first sweep), "clook"
+ * (one sweep, reads and writes alike) or "deadline" (clook with read and
+ * write expiry times). Majors not listed here use "elevator".
+ */
+#define IOSCHED_TABLE {3, "deadline"}
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
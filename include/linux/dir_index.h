@@ -0,0 +1,46 @@
+#ifndef _DIR_INDEX_H
+#define _DIR_INDEX_H
+
+/*
+ * Hashed directory index. This is shared between fs/namei.c and the
+ * host-side tools/dirindex.c that builds and checks it, so it must not
+ * depend on anything else in the kernel.
+ *
+ * An indexed directory is an ordinary minix directory laid out as a hash
+ * table: block 0 holds ".", ".." and the index header in slot
+ * DIR_INDEX_SLOT, blocks 1..nbuckets are the buckets, and a name lives in
+ * block dir_index_block(), or anywhere in block 0. The header has inode 0
+ * in the place of a dir_entry, so a linear scan just sees a free slot.
+ *
+ * If a name had to go anywhere else DIR_INDEX_OVERFLOW is set, and a miss
+ * in the bucket still has to scan the whole directory. mtime and size
+ * are the i_mtime and i_size of the directory when the index was last
+ * updated: a kernel that doesn't know about the index changes at least
+ * one of them when it adds a name, and the index is ignored from then on.
+ */
+#define DIR_INDEX_MAGIC		0x4849		/* "IH" */
+#define DIR_INDEX_SLOT		2
+#define DIR_INDEX_OVERFLOW	1
+
+struct dir_index {
+	unsigned short inode;		/* always 0 */
+	unsigned short magic;
+	unsigned short nbuckets;
+	unsigned short flags;
+	unsigned int mtime;
+	unsigned int size;
+};
+
+static inline unsigned int dir_hash(const char * name, int len)
+{
+	unsigned int hash = 0;
+
+	while (len-- > 0 && *name)
+		hash = hash * 31 + (unsigned char) *name++;
+	return hash;
+}
+
+#define dir_index_block(di,name,len) \
+	(1 + dir_hash((name),(len)) % (di)->nbuckets)
+
+#endif
@@ -41,10 +41,9 @@ void buffer_init(long buffer_end);
 #define SUPER_MAGIC 0x137F
 
 #define NR_OPEN 20
-#define NR_INODE 32
+#define NR_INODE nr_inodes
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -52,35 +51,89 @@ void buffer_init(long buffer_end);
 #define NULL ((void *)0)
 #endif
 
-#define INODES_PER_BLOCK ((BLOCK_SIZE) / (sizeof(struct d_inode)))
-#define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE) / (sizeof(struct dir_entry)))
+/*
+ * A filesystem has blocks of 1kB, or of 4kB if s_log_zone_size is 2:
+ * then every block number on it, for the bitmaps and inodes too, is in
+ * 4kB units. The super block is at 1kB either way, so the bitmaps start
+ * in block 2 or block 1. Other block sizes are not supported.
+ */
+#define FIRST_MAP_BLOCK(sb) ((2 * BLOCK_SIZE + (sb)->s_blocksize - 1) >> (sb)->s_blocksize_bits)
+#define INODES_PER_BLOCK(sb) ((sb)->s_blocksize / (sizeof(struct d_inode)))
+
+/* the same for an inode, which has its filesystem's block size in i_blkbits */
+#define I_BLOCK_SIZE(inode) (1 << (inode)->i_blkbits)
+#define DIR_ENTRIES_PER_BLOCK(inode) (I_BLOCK_SIZE(inode) / (sizeof(struct dir_entry)))
+#define ADDR_BITS(inode) ((inode)->i_blkbits - 1)
+#define ADDR_PER_BLOCK(inode) (1 << ADDR_BITS(inode))
+#define MAX_FILE_BLOCKS(inode) \
+	(7 + ADDR_PER_BLOCK(inode) + ADDR_PER_BLOCK(inode) * ADDR_PER_BLOCK(inode))
 
+/*
+ * A pipe is a ring of up to PIPE_MAX_PAGES pages. i_size holds the length
+ * of the ring in bytes, i_zone[0]/[1] the head/tail offsets into it and
+ * i_zone[2..8] the page frame numbers of its pages.
+ */
+#define PIPE_MAX_PAGES 7
+#define PIPE_LEN(inode) ((inode).i_size)
 #define PIPE_HEAD(inode) ((inode).i_zone[0])
 #define PIPE_TAIL(inode) ((inode).i_zone[1])
-#define PIPE_SIZE(inode) ((PIPE_HEAD(inode) - PIPE_TAIL(inode)) & (PAGE_SIZE - 1))
+/* 16-bit page numbers: this is why MAX_MEMORY is 256Mb */
+#define PIPE_PAGE(inode, n) ((unsigned long)(inode).i_zone[2 + (n)] << 12)
+#define PIPE_SIZE(inode) ((PIPE_HEAD(inode) >= PIPE_TAIL(inode)) ? \
+	(PIPE_HEAD(inode) - PIPE_TAIL(inode)) : \
+	(PIPE_HEAD(inode) + PIPE_LEN(inode) - PIPE_TAIL(inode)))
 #define PIPE_EMPTY(inode) (PIPE_HEAD(inode) == PIPE_TAIL(inode))
-#define PIPE_FULL(inode) (PIPE_SIZE(inode) == (PAGE_SIZE - 1))
-#define INC_PIPE(head) \
-	__asm__("incl %0\n\tandl $4095,%0" ::"m"(head))
+#define PIPE_FULL(inode) (PIPE_SIZE(inode) == PIPE_LEN(inode) - 1)
 
 typedef char buffer_block[BLOCK_SIZE];
 
 struct buffer_head
 {
-	char *b_data;				/* 数据区 pointer to data block (1024 bytes) */
-	unsigned long b_blocknr;	/* 数据逻辑块号 1K block number */
-	unsigned short b_dev;		/* 块设备号（硬盘上的） 1K device (0 = free) */
+	char *b_data;				/* 数据区 pointer to data block (b_size bytes) */
+	unsigned long b_blocknr;	/* 数据逻辑块号 block number, in b_size units */
+	unsigned short b_dev;		/* 块设备号（硬盘上的） device (0 = free) */
+	unsigned short b_size;		/* BLOCK_SIZE, or a page: see buffer.c */
 	unsigned char b_uptodate;	//更新的标志位
 	unsigned char b_dirt;		/* 是否为脏位 写盘的时候检索的标志位 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 锁 0 - ok, 1 -locked */
+	unsigned char b_list;		/* lru list the buffer is on when b_count==0 */
 	struct task_struct *b_wait; //等待该高速缓冲区释放的进程结构体指针 等待该高速缓冲区解锁的进程指针
 	struct buffer_head *b_prev;
 	struct buffer_head *b_next;
 	struct buffer_head *b_prev_free; //构成了空闲缓冲区的循环链表（当前高速缓冲区中所有剩余的没有用到的缓冲区的循环链表）
-	struct buffer_head *b_next_free;
+	struct buffer_head *b_next_free; /* (only linked while b_count==0) */
+	unsigned long b_flushtime;		 /* jiffies when a dirty buffer is due */
+	struct buffer_head *b_reqnext;	 /* next block of the same request */
+	struct buffer_head *b_next_all;	 /* every buffer head, see buffer.c */
+	struct buffer_head *b_delay_next; /* delayed blocks of an inode, see inode.c */
+	/* first head of a group only: its buffers on a clean list, see buffer.c */
+	unsigned char b_idle;
+	struct buffer_head *b_prev_idle;
+	struct buffer_head *b_next_idle;
 };
 
+/*
+ * Unused buffers live on one of these lru lists, least recently
+ * released first. Buffers in use (b_count != 0) are on no list at all.
+ * Clean page sized buffers have a list of their own, so that a victim
+ * of the right size is found at once.
+ */
+#define BUF_CLEAN 0
+#define BUF_DIRTY 1
+#define BUF_PAGE 2
+#define NR_LIST 3
+
+/*
+ * bdflush(func, data): BDF_RUN turns the caller into the write-back
+ * daemon and never returns, BDF_STATS copies BDF_NSTATS longs (buffers,
+ * unused dirty buffers, flushed by the daemon, daemon runs, foreground
+ * writes, dirty victims) to the user array at 'data'.
+ */
+#define BDF_RUN 0
+#define BDF_STATS 1
+#define BDF_NSTATS 6
+
 //Linux把inode分为两种方式保存，一种是在硬盘中的inode（d_inode），一种是在内存中的inode（m_inode）。m_inode除了完全包含d_inode中的字段之外还有一些专门的字段。
 struct d_inode
 {
@@ -114,13 +167,30 @@ struct m_inode
 	unsigned short i_dev;		// i节点所在的设备号
 	unsigned short i_num;		// i节点号   就是逻辑块的索引
 	unsigned short i_count;		// i节点被打开的次数，0是空闲  I结点被打开次数，主要用于判断文件是否共享！
-	unsigned char i_lock;		// 判断I结点是否被锁住。
+	unsigned char i_lock;		// 判断I结点是否被锁住。 2: and somebody waits
 	unsigned char i_dirt;		// 判断I结点是否需要写回磁盘。
 	unsigned char i_pipe;		// i节点用作管道标志
 								// pipi会对应一块无聊内存，所以根本不需要写盘
 	unsigned char i_mount;		// 如果有文件系统安装在此结点上，则置此位   也就是说这个节点作为一个目录了
 	unsigned char i_seek;		// 在lseek调用时置此位  lseek是一个用于改变读写一个文件时读写指针位置的一个系统调用
 	unsigned char i_update;		// i节点已更新的标志
+	struct m_inode *i_hash_next;	/* hashed on (i_dev,i_num) while i_dev != 0 */
+	struct m_inode **i_hash_pprev;
+	struct m_inode *i_free_next;	/* on the unused list while i_count == 0 */
+	struct m_inode *i_free_prev;
+	struct text_page *i_pages;		/* cached text pages, see mm/memory.c */
+	unsigned short i_prealloc;		/* next block of the preallocation window */
+	unsigned short i_prealloc_count;	/* and how many are left in it */
+	struct buffer_head *i_delayed;		/* written blocks without a zone yet */
+	unsigned short i_nr_delayed;
+	unsigned long i_delay_time;		/* jiffies when the first one came */
+	/* block map cache, see bmap(): only ever holds blocks that exist */
+	unsigned long i_run_block;		/* file blocks from i_run_block on */
+	unsigned short i_run_zone;		/* are in the zones from i_run_zone on */
+	unsigned short i_run_len;		/* for this many blocks */
+	unsigned short i_dind_index;	/* entry+1 of the double indirect block */
+	unsigned short i_dind_zone;		/* and what is in it */
+	unsigned char i_blkbits;		/* log2 of the block size of i_dev */
 };
 
 struct file
@@ -130,6 +200,10 @@ struct file
 	unsigned short f_count;
 	struct m_inode *f_inode;
 	off_t f_pos;
+	/* read-ahead state, see file_read() */
+	unsigned long f_ranext;	 /* block a sequential reader wants next */
+	unsigned long f_raend;	 /* read-ahead started up to this block */
+	unsigned short f_rawin; /* window in blocks, 0 after a random read */
 };
 
 struct super_block
@@ -153,6 +227,16 @@ struct super_block
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt; //已被修改的配置
+	/* free bits in each bitmap block, and in all of them, see bitmap.c */
+	unsigned short s_zmap_free[Z_MAP_SLOTS];
+	unsigned short s_imap_free[I_MAP_SLOTS];
+	unsigned long s_free_zones;
+	unsigned long s_free_inodes;
+	unsigned long s_zmap_next; /* bit to start the next search at */
+	unsigned long s_imap_next;
+	unsigned long s_reserved;  /* zones promised to delayed blocks */
+	unsigned short s_blocksize; /* BLOCK_SIZE << s_log_zone_size */
+	unsigned char s_blocksize_bits;
 };
 
 struct d_super_block
@@ -173,7 +257,8 @@ struct dir_entry
 	char name[NAME_LEN];	//名字
 };
 
-extern struct m_inode inode_table[NR_INODE];
+extern struct m_inode *inode_table;
+extern int nr_inodes;
 extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head *start_buffer;
@@ -186,28 +271,60 @@ extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
 extern void truncate(struct m_inode *inode);
 extern void sync_inodes(void);
+extern struct buffer_head *get_delayed(struct m_inode *inode, int block, int create);
+#define NO_DELAY_SPACE ((struct buffer_head *) -1)
+extern void flush_delayed(struct m_inode *inode);
+extern void discard_delayed(struct m_inode *inode);
+extern void sync_delayed(int dev, int force);
+extern struct buffer_head *get_unhashed_buffer(int size);
 extern void wait_on(struct m_inode *inode);
 extern int bmap(struct m_inode *inode, int block);
+extern int bmap_range(struct m_inode *inode, int block, int *zones, int count);
 extern int create_block(struct m_inode *inode, int block);
 extern struct m_inode *namei(const char *pathname);
+extern void set_dir_mtime(struct m_inode *dir, long mtime);
 extern int open_namei(const char *pathname, int flag, int mode,
 					  struct m_inode **res_inode);
 extern void iput(struct m_inode *inode);
 extern struct m_inode *iget(int dev, int nr);
 extern struct m_inode *get_empty_inode(void);
 extern struct m_inode *get_pipe_inode(void);
+extern void free_pipe_pages(struct m_inode *inode);
+extern int set_pipe_size(struct m_inode *inode, unsigned long size);
 extern struct buffer_head *get_hash_table(int dev, int block);
 extern struct buffer_head *getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head *bh);
+extern void ll_rw_page(int rw, int dev, int page, char *buffer);
 extern void brelse(struct buffer_head *buf);
 extern struct buffer_head *bread(int dev, int block);
-extern void bread_page(unsigned long addr, int dev, int b[4]);
+extern void bread_page(unsigned long addr, int dev, int b[], int offset);
 extern struct buffer_head *breada(int dev, int block, ...);
-extern int new_block(int dev);
+extern void bread_ahead(int dev, int block);
+extern int new_block(int dev, int goal);
+extern int new_file_block(struct m_inode *inode, int goal, int reserved);
+extern void free_prealloc(struct m_inode *inode);
+extern void count_free(struct super_block *sb);
 extern void free_block(int dev, int block);
 extern struct m_inode *new_inode(int dev);
 extern void free_inode(struct m_inode *inode);
 extern int sync_dev(int dev);
+extern void show_buffers(void);
+extern int get_blocksize(int dev);
+extern int set_blocksize(int dev, int size);
+extern int shrink_buffers(void);
+extern void show_inodes(void);
+extern void insert_inode_hash(struct m_inode *inode);
+extern void clear_inode(struct m_inode *inode);
+extern long inode_init(long mem_start, int nr);
+extern void free_text_pages(struct m_inode *inode);
+extern unsigned long dcache_version;
+extern int dcache_lookup(int dev, int dir, const char *name, int len);
+extern void dcache_add(int dev, int dir, const char *name, int len, int ino);
+extern void dcache_remove(int dev, int dir, const char *name, int len);
+extern void dcache_invalidate_dir(int dev, int dir);
+extern void dcache_invalidate_dev(int dev);
+extern void dcache_init(void);
+extern void show_dcache(void);
 extern struct super_block *get_super(int dev);
 extern int ROOT_DEV;
 
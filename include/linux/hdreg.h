@@ -40,6 +40,33 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_MULTREAD		0xC4	/* a block of sectors per interrupt */
+#define WIN_MULTWRITE		0xC5
+#define WIN_SETMULT		0xC6	/* sets the block size for the above */
+#define WIN_READDMA		0xC8
+#define WIN_WRITEDMA		0xCA
+#define WIN_IDENTIFY		0xEC	/* 256 words of drive info */
+
+/* 48-bit LBA versions of the transfer commands */
+#define WIN_READ_EXT		0x24
+#define WIN_READDMA_EXT		0x25
+#define WIN_MULTREAD_EXT	0x29
+#define WIN_WRITE_EXT		0x34
+#define WIN_WRITEDMA_EXT	0x35
+#define WIN_MULTWRITE_EXT	0x39
+
+/* Words of the IDENTIFY data */
+#define ID_MULTIPLE	47	/* low byte: max sectors for MULTREAD/WRITE */
+#define ID_CAPABILITY	49	/* 0x100: DMA, 0x200: LBA */
+#define ID_LBA_SECTS	60	/* 2 words, sectors reachable with LBA28 */
+#define ID_COMMAND_SET	83	/* 0x400: 48-bit LBA */
+#define ID_LBA48_SECTS	100	/* 4 words, sectors reachable with LBA48 */
+
+/* Bus-master IDE (SFF-8038i) registers, offsets from the BAR4 base */
+#define BM_COMMAND	0	/* 1: start, 8: transfer to memory */
+#define BM_STATUS	2	/* 1: active, 2: error, 4: interrupt */
+#define BM_PRD		4	/* physical address of the PRD table */
+#define BM_PRD_EOT	0x80000000
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
@@ -62,4 +89,7 @@ struct partition {
 	unsigned int nr_sects;		/* nr of sectors in partition */
 };
 
+/* sys_ind of the partitions that hold a chain of logical ones */
+#define IS_EXTENDED(ind) ((ind) == 0x05 || (ind) == 0x0f || (ind) == 0x85)
+
 #endif
@@ -3,8 +3,51 @@
 
 #define PAGE_SIZE 4096
 
+/* these are not to be changed without changing head.s etc */
+#define LOW_MEM 0x100000
+#define MAP_NR(addr) (((addr)-LOW_MEM) >> 12)
+#define USED 100
+
+/*
+ * Pipes keep their pages as 16-bit page numbers (see PIPE_PAGE), which
+ * is what limits us to 256Mb. Anything above it is simply not used.
+ */
+#define MAX_MEMORY (256 * 1024 * 1024)
+
+/*
+ * Every task has a page directory of its own (tss.cr3). The entries below
+ * TASK_BASE are the same in all of them, and map physical memory 1:1 for
+ * the kernel. User space is the TASK_SIZE bytes at TASK_BASE - the same
+ * linear addresses for every task, so the number of tasks no longer has
+ * anything to do with the size of the linear address space.
+ */
+#define TASK_BASE 0x40000000
+#define TASK_SIZE 0x4000000
+
+/* the directory entry for linear address 'addr' in page directory 'dir' */
+#define dir_entry(dir, addr) \
+	((unsigned long *)(dir) + ((unsigned long)(addr) >> 22))
+
+extern unsigned char *mem_map;
+extern unsigned long HIGH_MEMORY;
+
+/* reload cr3 with whatever directory is current: that flushes the tlb */
+#define invalidate() \
+	__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3" ::: "ax")
+
+extern int SWAP_DEV;
+
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_page_atomic(void);
+extern int free_page_count(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern void refill_zero_pages(void);
+extern long paging_init(long start_mem, long end_mem);
+extern void init_swapping(int swap_size);
+extern int swap_out(void);
+extern int swap_in(unsigned long *table_ptr);
+extern void swap_free(int nr);
+extern void swap_duplicate(int nr);
 
 #endif
@@ -10,6 +10,7 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
 #include <signal.h>
 
 #if (NR_OPEN > 32)
@@ -26,8 +27,9 @@
 #define NULL ((void *)0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, unsigned long size);
+extern int copy_page_tables(unsigned long *to_dir, unsigned long from, unsigned long to, long size);
+extern int share_page_tables(unsigned long *to_dir, unsigned long from, unsigned long to, long size);
+extern int free_page_tables(unsigned long *dir, unsigned long from, unsigned long size);
 
 extern void sched_init(void);
 extern void schedule(void);
@@ -111,6 +113,14 @@ struct task_struct
 	struct desc_struct ldt[3]; // ldt包括两个东西，一个是数据段（全局变量静态变量等），另一个是代码段，不过这里面存的都是指针
 	/* tss for this task */
 	struct tss_struct tss; //进程运行过程中CPU需要知道的进程状态标志（段属性、位属性等）
+	/* scheduler state, see kernel/sched.c. Not set up by INIT_TASK. */
+	int nr;								/* index in task[] */
+	struct prio_array *array;			/* run queue array we are on, or NULL */
+	struct task_struct *run_next;
+	unsigned long epoch;				/* last counter recalculation seen */
+	struct timer_list alarm_timer;		/* pending while alarm != 0 */
+	int vforked;						/* using our parent's memory */
+	struct task_struct *vfork_wait;		/* the parent waits here meanwhile */
 };
 
 /*
@@ -142,10 +152,17 @@ extern long startup_time;
 
 #define CURRENT_TIME (startup_time + jiffies / HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
+/* the page directory of task p, see <linux/mm.h> */
+#define task_dir(p) ((unsigned long *)(p)->tss.cr3)
+
 extern void sleep_on(struct task_struct **p);
 extern void interruptible_sleep_on(struct task_struct **p);
 extern void wake_up(struct task_struct **p);
+extern void wake_up_process(struct task_struct *p);
+extern void signal_wake_up(struct task_struct *p);
+extern void set_alarm(struct task_struct *p, long when);
+extern void vfork_release(void);
+extern unsigned long sched_epoch;
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
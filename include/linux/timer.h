@@ -0,0 +1,26 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/*
+ * Kernel timers. A timer_list is owned by whoever uses it (usually it is
+ * embedded in some other structure), so arming and cancelling it never
+ * needs any memory. mod_timer() (re)arms it to call function(data) from
+ * the timer interrupt once jiffies reaches expires, del_timer() cancels
+ * it. Both are O(1), see kernel/timer.c.
+ */
+struct timer_list {
+	struct timer_list * next;
+	struct timer_list ** pprev;		/* NULL when not pending */
+	unsigned long expires;
+	void (*function)(unsigned long);
+	unsigned long data;
+};
+
+#define timer_pending(t) ((t)->pprev != NULL)
+
+extern void init_timer(struct timer_list * timer);
+extern void mod_timer(struct timer_list * timer, unsigned long expires);
+extern int del_timer(struct timer_list * timer);
+extern void run_timers(void);
+
+#endif
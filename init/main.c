@@ -21,6 +21,7 @@
  * some others too.
  */
 static inline _syscall0(int, fork) static inline _syscall0(int, pause) static inline _syscall1(int, setup, void *, BIOS) static inline _syscall0(int, sync)
+_syscall2(int, bdflush, int, func, long, data)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -54,8 +55,19 @@ extern long startup_time;
  全局变量 都是在boot阶段读入的，然后放到宏定义中
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
+#define EXT_MEM_16M (*(unsigned short *)0x9000E)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC)
+#define BOOT_NR_INODES (*(unsigned short *)0x901FA)
+#define ORIG_SWAP_DEV (*(unsigned short *)0x901F8)
+#define BOOT_BUFFER_K (*(unsigned short *)0x901F6)
+
+/*
+ * The buffer cache set up at boot has to end well below 16Mb: main
+ * memory starts right after it, and paging_init() needs that to be
+ * inside what head.s has mapped. Past this the cache grows at run time.
+ */
+#define BUFFER_STATIC_MAX (12 * 1024 * 1024)
 
 /*
  * Yeah, yeah, it's ugly, but I cannot find how to do this correctly
@@ -113,26 +125,45 @@ void main(void)				  /* This really IS void, no error here. */
 							   */
 							  //前面这里做的所有事情都是在对内存进行拷贝
 	ROOT_DEV = ORIG_ROOT_DEV; //设置操作系统的根文件
+	SWAP_DEV = ORIG_SWAP_DEV; //交换设备，0表示不使用交换
 	drive_info = DRIVE_INFO;  //设置操作系统驱动参数
 							  //解析setup.s代码后获取系统内存参数
 							  
 	memory_end = (1 << 20) + (EXT_MEM_K << 10);
+	/* int 0x15/0x88 can't count past 64Mb: setup.s asked for more with 0xe801 */
+	if (EXT_MEM_16M)
+		memory_end = (16 << 20) + ((long)EXT_MEM_16M << 16);
 	//取整4k的内存大小
 	memory_end &= 0xfffff000;
-	if (memory_end > 16 * 1024 * 1024) //控制操作系统的最大内存为16M
-		memory_end = 16 * 1024 * 1024; //cpu往块设备写数据，会先写入这里的缓存，缓存到一定数量后统一写入设备
-	if (memory_end > 12 * 1024 * 1024)
+	if (memory_end > MAX_MEMORY) //控制操作系统的最大内存
+		memory_end = MAX_MEMORY; //cpu往块设备写数据，会先写入这里的缓存，缓存到一定数量后统一写入设备
+	if (BOOT_BUFFER_K)
+		buffer_memory_end = (long)BOOT_BUFFER_K << 10;
+	else if (memory_end > 32 * 1024 * 1024)
+		buffer_memory_end = memory_end / 8;
+	else if (memory_end > 12 * 1024 * 1024)
 		//设置高速缓冲区的大小，跟块设备有关，跟设备交互的时候，充当缓冲区，写入到块设备中的数据先放在缓冲区里，只有执行sync时才真正写入；这也是为什么要区分块设备驱动和字符设备驱动；块设备写入需要缓冲区，字符设备不需要是直接写入的
 		buffer_memory_end = 4 * 1024 * 1024; 
 	else if (memory_end > 6 * 1024 * 1024)
 		buffer_memory_end = 2 * 1024 * 1024;
 	else
 		buffer_memory_end = 1 * 1024 * 1024;
+	if (buffer_memory_end > memory_end / 2)
+		buffer_memory_end = memory_end / 2;
+	if (buffer_memory_end > BUFFER_STATIC_MAX)
+		buffer_memory_end = BUFFER_STATIC_MAX;
+	if (buffer_memory_end < 1024 * 1024)
+		buffer_memory_end = 1024 * 1024;
+	buffer_memory_end &= 0xfffff000;
 	main_memory_start = buffer_memory_end;
 #ifdef RAMDISK
 	main_memory_start += rd_init(main_memory_start, RAMDISK * 1024);
 #endif
+	// i节点表的大小: 引导扇区里给了就用它, 否则每32K内存一个 (16M内存时512个)
+	main_memory_start += inode_init(main_memory_start,
+		BOOT_NR_INODES ? BOOT_NR_INODES : (memory_end >> 15));
 	//内存控制器初始化
+	main_memory_start = paging_init(main_memory_start, memory_end);
 	mem_init(main_memory_start, memory_end);
 	//异常函数初始化
 	trap_init();
@@ -148,6 +179,7 @@ void main(void)				  /* This really IS void, no error here. */
 	sched_init();
 	//高速缓冲区初始化
 	buffer_init(buffer_memory_end);
+	dcache_init();
 	//硬盘初始化
 	hd_init();
 	//软盘初始化
@@ -195,6 +227,9 @@ void init(void)
 	int pid, i;
 	//设置了驱动信息
 	setup((void *)&drive_info);
+	//启动回写守护进程 它在内核里循环 不会返回
+	if (!fork())
+		_exit(bdflush(BDF_RUN, 0));
 	//打开标准输入控制台 句柄为0
 	(void)open("/dev/tty0", O_RDWR, 0);
 	(void)dup(0); //打开标准输入控制台 这里是复制句柄的意思
@@ -14,11 +14,22 @@
  */
 #define NR_REQUEST	32
 
+/*
+ * Adjacent blocks are merged into one request, up to this many sectors.
+ * It has to fit in the hd sector count register.
+ */
+#define MAX_SECTORS	128
+
 /*
  * Ok, this is an expanded form so that we can use the same
  * request for paging requests when that is implemented. In
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
+ *
+ * A request covers a chain of buffers (linked through b_reqnext)
+ * for consecutive blocks. 'sector', 'buffer' and 'current_nr_sectors'
+ * describe what is left of the first buffer in the chain, 'nr_sectors'
+ * what is left of the whole request.
  */
 struct request {
 	int dev;		/* -1 if no request */
@@ -26,9 +37,13 @@ struct request {
 	int errors;
 	unsigned long sector;
 	unsigned long nr_sectors;
+	unsigned long current_nr_sectors;
 	char * buffer;
 	struct task_struct * waiting;
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
+	unsigned long start_time;	/* jiffies when queued */
+	unsigned long deadline;		/* used by the deadline elevator */
 	struct request * next;
 };
 
@@ -42,15 +57,35 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector)))
 
+/*
+ * An elevator orders the request queue of a device. add() puts a new
+ * request somewhere after the head of a non-empty queue. next() is
+ * called when the head is done, and may move the request that should be
+ * served next right behind it. Both are called with interrupts off.
+ */
+struct elevator {
+	const char * name;
+	void (*add)(struct request * head, struct request * req);
+	void (*next)(struct request * head);
+};
+
+/* queue-to-completion latency in ticks: 0, 1, 2-3, 4-7, ... 64 and up */
+#define NR_LATENCY	8
+
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	struct elevator * elevator;
+	unsigned long latency[NR_LATENCY];
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 extern struct request request[NR_REQUEST];
 extern struct task_struct * wait_for_request;
 
+extern struct elevator * find_elevator(const char * name);
+extern struct request * next_request(struct blk_dev_struct * dev);
+
 #ifdef MAJOR_NR
 
 /*
@@ -80,7 +115,15 @@ extern struct task_struct * wait_for_request;
 #define DEVICE_NAME "harddisk"
 #define DEVICE_INTR do_hd
 #define DEVICE_REQUEST do_hd_request
-#define DEVICE_NR(device) (MINOR(device)/5)
+/*
+ * Minors 0-9 are the two drives and their primary partitions, 5 a drive.
+ * The logical partitions in an extended partition start at minor 16,
+ * NR_LOGICAL a drive.
+ */
+#define NR_LOGICAL 24
+#define LOGICAL_MINOR(drive) (16+NR_LOGICAL*(drive))
+#define DEVICE_NR(device) ((MINOR(device) < 16) ? MINOR(device)/5 : \
+	(MINOR(device)-16)/NR_LOGICAL)
 #define DEVICE_ON(device)
 #define DEVICE_OFF(device)
 
@@ -106,22 +149,39 @@ extern inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * end_request() finishes the first buffer of the current request. If
+ * more buffers were merged into the request, it moves on to the next
+ * one and leaves the request current, so the driver just continues.
+ */
 extern inline void end_request(int uptodate)
 {
-	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
+	struct buffer_head * bh;
+
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		printk("dev %04x, sector %d\n\r",CURRENT->dev,
+			CURRENT->sector);
 	}
+	if ((bh = CURRENT->bh) != NULL) {
+		CURRENT->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+		if ((bh = CURRENT->bh) != NULL) {
+			CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
+			CURRENT->current_nr_sectors = bh->b_size >> 9;
+			CURRENT->sector = bh->b_blocknr *
+				CURRENT->current_nr_sectors;
+			CURRENT->buffer = bh->b_data;
+			CURRENT->errors = 0;
+			return;
+		}
+	}
+	DEVICE_OFF(CURRENT->dev);
 	wake_up(&CURRENT->waiting);
 	wake_up(&wait_for_request);
-	CURRENT->dev = -1;
-	CURRENT = CURRENT->next;
+	CURRENT = next_request(blk_dev + MAJOR_NR);
 }
 
 #define INIT_REQUEST \
@@ -0,0 +1,101 @@
+/*
+ *  linux/kernel/blk_drv/elevator.c
+ *
+ * (C) 1991 Linus Torvalds
+ */
+
+/*
+ * This decides in what order the requests of a block device are
+ * served. Every major gets one of the elevators below in blk_dev_init(),
+ * see IOSCHED_TABLE in <linux/config.h>.
+ */
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#include "blk.h"
+
+/*
+ * The original elevator: reads before writes, then an ascending sweep
+ * over the disk which starts again at the bottom when it runs out.
+ */
+static void elevator_add(struct request *tmp, struct request *req)
+{
+	for (; tmp->next; tmp = tmp->next)
+		if ((IN_ORDER(tmp, req) ||
+			 !IN_ORDER(tmp, tmp->next)) &&
+			IN_ORDER(req, tmp->next))
+			break;
+	req->next = tmp->next;
+	tmp->next = req;
+}
+
+/*
+ * C-LOOK: the same sweep, but reads and writes are treated alike, so a
+ * long run of writes no longer gets split by every read.
+ */
+#define CLOOK_ORDER(s1, s2)                              \
+	((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
+							   (s1)->sector < (s2)->sector))
+
+static void clook_add(struct request *tmp, struct request *req)
+{
+	for (; tmp->next; tmp = tmp->next)
+		if ((CLOOK_ORDER(tmp, req) ||
+			 !CLOOK_ORDER(tmp, tmp->next)) &&
+			CLOOK_ORDER(req, tmp->next))
+			break;
+	req->next = tmp->next;
+	tmp->next = req;
+}
+
+/*
+ * deadline: C-LOOK order, but every request also gets an expiry time,
+ * reads a lot sooner than writes. When the head of the queue is done and
+ * something has expired, the oldest expired request goes next, so reads
+ * can't starve behind a long write sweep (or the other way around).
+ */
+#define READ_EXPIRE (HZ / 2)
+#define WRITE_EXPIRE (5 * HZ)
+
+static void deadline_add(struct request *tmp, struct request *req)
+{
+	req->deadline = req->start_time +
+					((req->cmd == READ) ? READ_EXPIRE : WRITE_EXPIRE);
+	clook_add(tmp, req);
+}
+
+static void deadline_next(struct request *head)
+{
+	struct request *tmp, *prev, *best = NULL, *best_prev = NULL;
+
+	for (prev = head; (tmp = prev->next) != NULL; prev = tmp)
+		if (tmp->deadline <= (unsigned long)jiffies &&
+			(!best || tmp->deadline < best->deadline))
+		{
+			best = tmp;
+			best_prev = prev;
+		}
+	if (!best || best_prev == head)
+		return;
+	best_prev->next = best->next;
+	best->next = head->next;
+	head->next = best;
+}
+
+static struct elevator elevators[] = {
+	{"elevator", elevator_add, NULL},
+	{"clook", clook_add, NULL},
+	{"deadline", deadline_add, deadline_next},
+	{NULL, NULL, NULL}};
+
+struct elevator *find_elevator(const char *name)
+{
+	struct elevator *e;
+
+	for (e = elevators; e->name; e++)
+		if (!strcmp(e->name, name))
+			return e;
+	return NULL;
+}
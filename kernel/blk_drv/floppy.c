@@ -401,6 +401,33 @@ static void reset_floppy(void)
 	sti();
 }
 
+/*
+ * Waiting for the motor to spin up, or for a new drive select to settle,
+ * is done on a timer of our own. There's never more than one such wait
+ * pending, so one timer will do, and the timer interrupt calls fn.
+ */
+static struct timer_list floppy_timer;
+
+static void floppy_timeout(unsigned long fn)
+{
+	((void (*)(void)) fn)();
+}
+
+static void floppy_delay(long ticks, void (*fn)(void))
+{
+	unsigned long flags;
+
+	if (ticks <= 0) {	/* as from the timer: interrupts off */
+		save_flags(flags);
+		cli();
+		fn();
+		restore_flags(flags);
+		return;
+	}
+	floppy_timer.data = (unsigned long) fn;
+	mod_timer(&floppy_timer, jiffies + ticks);
+}
+
 static void floppy_on_interrupt(void)
 {
 /* We cannot do a floppy-select, as that might sleep. We just force it */
@@ -409,7 +436,7 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		floppy_delay(2,&transfer);
 	} else
 		transfer();
 }
@@ -451,12 +478,14 @@ void do_fd_request(void)
 		command = FD_WRITE;
 	else
 		panic("do_fd_request: unknown command");
-	add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+	floppy_delay(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
 }
 
 void floppy_init(void)
 {
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	init_timer(&floppy_timer);
+	floppy_timer.function = floppy_timeout;
 	set_trap_gate(0x26,&floppy_interrupt);
 	outb(inb_p(0x21)&~0x40,0x21);
 }
@@ -11,6 +11,10 @@
  * sleep. Special care is recommended.
  * 
  *  modified by Drew Eckhardt to check nr of hd's from the CMOS.
+ *
+ * Drives that can do it transfer a block of sectors per interrupt
+ * (READ/WRITE MULTIPLE), and if there is a PCI bus-master IDE controller
+ * (like the PIIX) whole requests go by DMA, with a single interrupt.
  */
 
 #include <linux/config.h>
@@ -33,6 +37,8 @@ inb_p(0x71); \
 /* Max read/write errors/sector */
 #define MAX_ERRORS	7
 #define MAX_HD		2
+/* Largest block we ask for in multiple mode */
+#define MAX_MULT	16
 
 static void recal_intr(void);
 
@@ -53,10 +59,57 @@ struct hd_i_struct hd_info[] = { {0,0,0,0,0,0},{0,0,0,0,0,0} };
 static int NR_HD = 0;
 #endif
 
+#define HD_MINORS LOGICAL_MINOR(MAX_HD)
+
 static struct hd_struct {
-	long start_sect;
-	long nr_sects;
-} hd[5*MAX_HD]={{0,0},};
+	unsigned long start_sect;
+	unsigned long nr_sects;
+} hd[HD_MINORS]={{0,0},};
+
+/*
+ * What the drives can do besides a sector at a time, from IDENTIFY.
+ * mult is the block size for READ/WRITE MULTIPLE, 0 if it isn't used.
+ * A reset puts the drive back into single sector mode, so set_mult says
+ * that SET MULTIPLE must be sent before the next command. Drives with
+ * lba set are addressed by sector number instead of CHS, and lba48 ones
+ * can use the EXT commands for sectors past the first 2^28.
+ */
+static struct hd_caps {
+	int mult;
+	int set_mult;
+	int dma;
+	int lba;
+	int lba48;
+} hd_caps[MAX_HD] = {{0,0,0,0,0},};
+
+#define MULT(drive) (hd_caps[drive].mult ? hd_caps[drive].mult : 1)
+
+/* transfer commands by [48-bit][mode][write] */
+#define HD_PIO	0
+#define HD_MULT	1
+#define HD_DMA	2
+
+static unsigned char hd_cmds[2][3][2] = {
+	{{WIN_READ,WIN_WRITE},
+	 {WIN_MULTREAD,WIN_MULTWRITE},
+	 {WIN_READDMA,WIN_WRITEDMA}},
+	{{WIN_READ_EXT,WIN_WRITE_EXT},
+	 {WIN_MULTREAD_EXT,WIN_MULTWRITE_EXT},
+	 {WIN_READDMA_EXT,WIN_WRITEDMA_EXT}}
+};
+
+/* bus-master registers, and the PRD table in a page of its own */
+static unsigned short hd_bmide = 0;
+static unsigned long * hd_prd = NULL;
+
+/* sectors sent to the drive by the last hd_write_block() */
+static int hd_wcount = 0;
+
+/* statistics, see show_hd_stats() */
+static unsigned long nr_hd_cmds = 0;
+static unsigned long nr_hd_dma = 0;
+static unsigned long nr_hd_intr = 0;
+static unsigned long nr_hd_sectors = 0;
 
 #define port_read(port,buf,nr) \
 __asm__("cld;rep;insw"::"d" (port),"D" (buf),"c" (nr):"cx","di")
@@ -67,11 +120,151 @@ __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr):"cx","si")
 extern void hd_interrupt(void);
 extern void rd_load(void);
 
+static int controller_ready(void);
+
+#define PCI_CONFIG(bus,dev,fn,reg) \
+	(0x80000000 | ((bus)<<16) | ((dev)<<11) | ((fn)<<8) | (reg))
+
+static unsigned long pci_read(unsigned long addr)
+{
+	outl(addr,0xcf8);
+	return inl(0xcfc);
+}
+
+static void pci_write(unsigned long addr, unsigned long val)
+{
+	outl(addr,0xcf8);
+	outl(val,0xcfc);
+}
+
+/*
+ * Look for a bus-master IDE controller on PCI bus 0 (class 0x0101, with
+ * bit 7 of the programming interface set). Its registers are at BAR4;
+ * we only use the first channel, which is the one at 0x1f0.
+ */
+static void hd_dma_init(void)
+{
+	unsigned long addr,class,bar;
+
+	outl(0x80000000,0xcf8);
+	if (inl(0xcf8) != 0x80000000)
+		return;		/* no PCI configuration mechanism #1 */
+	for (addr = PCI_CONFIG(0,0,0,0) ; addr < PCI_CONFIG(1,0,0,0) ; addr += 0x100) {
+		if ((pci_read(addr) & 0xffff) == 0xffff)
+			continue;
+		class = pci_read(addr+8) >> 8;
+		if ((class >> 8) != 0x0101 || !(class & 0x80))
+			continue;
+		bar = pci_read(addr+0x20);
+		if (!(bar & 1))
+			continue;
+		if (!(hd_prd = (unsigned long *) get_free_page()))
+			return;
+		hd_bmide = bar & 0xfffc;
+/* i/o space and bus master enable; the status half is write-1-to-clear */
+		pci_write(addr+4,(pci_read(addr+4) & 0xffff) | 5);
+		printk("hd: bus-master IDE at %04x\n\r",hd_bmide);
+		return;
+	}
+}
+
+/*
+ * IDENTIFY is done before the request queue is used, and polled with the
+ * drive interrupt turned off (nIEN). Old drives don't know the command
+ * and abort it: they simply stay in single sector PIO mode.
+ */
+static void hd_identify(int drive)
+{
+	static unsigned short id[256];
+	int i;
+
+	outb_p(0xA0|(drive<<4),HD_CURRENT);
+	if (!controller_ready())
+		return;
+	outb_p(hd_info[drive].ctl | 2,HD_CMD);
+	outb(WIN_IDENTIFY,HD_COMMAND);
+	for (i = 0 ; i < 100000 ; i++)
+		if (!(inb_p(HD_STATUS) & BUSY_STAT))
+			break;
+	i = inb_p(HD_STATUS);
+	if (!(i & ERR_STAT) && (i & DRQ_STAT))
+		port_read(HD_DATA,id,256);
+	outb_p(hd_info[drive].ctl,HD_CMD);
+	if ((i & ERR_STAT) || !(i & DRQ_STAT))
+		return;
+	i = id[ID_MULTIPLE] & 0xff;
+	if (i > MAX_MULT)
+		i = MAX_MULT;
+	if (i > 1) {
+		hd_caps[drive].mult = i;
+		hd_caps[drive].set_mult = 1;
+	}
+	if (hd_bmide && (id[ID_CAPABILITY] & 0x100))
+		hd_caps[drive].dma = 1;
+/* the size the drive reports beats whatever the BIOS geometry says */
+	if (id[ID_CAPABILITY] & 0x200) {
+		hd_caps[drive].lba = 1;
+		hd[drive*5].nr_sects = id[ID_LBA_SECTS] |
+			(id[ID_LBA_SECTS+1] << 16);
+		if (id[ID_COMMAND_SET] & 0x400) {
+			hd_caps[drive].lba48 = 1;
+			if (id[ID_LBA48_SECTS+2] || id[ID_LBA48_SECTS+3])
+				hd[drive*5].nr_sects = 0xffffffff;
+			else
+				hd[drive*5].nr_sects = id[ID_LBA48_SECTS] |
+					(id[ID_LBA48_SECTS+1] << 16);
+		}
+	}
+	printk("hd%c: %u sectors%s, %d sectors per interrupt%s\n\r",'a'+drive,
+		hd[drive*5].nr_sects,
+		hd_caps[drive].lba48 ? ", LBA48" : (hd_caps[drive].lba ? ", LBA" : ""),
+		MULT(drive),hd_caps[drive].dma ? ", DMA" : "");
+}
+
+/*
+ * The logical partitions are a chain of extended boot records, starting
+ * at the beginning of the extended partition. The first entry of each
+ * is a partition, relative to the record itself, and the second links
+ * to the next record, relative to the start of the extended partition.
+ */
+static void extended_partition(int drive, unsigned long first)
+{
+	struct buffer_head * bh;
+	struct partition * p;
+	unsigned long this = first;
+	int minor = LOGICAL_MINOR(drive);
+	int i;
+
+	for (i = 0 ; i < 2*NR_LOGICAL && minor < LOGICAL_MINOR(drive+1) ; i++) {
+		if (!(bh = bread(0x300 + drive*5,this >> 1)))
+			return;
+		p = (struct partition *) (0x1BE + (this & 1)*512 + bh->b_data);
+		if (*(unsigned short *) (p+4) != 0xAA55) {
+			printk("Bad extended partition table on drive %d\n\r",drive);
+			brelse(bh);
+			return;
+		}
+		if (p->nr_sects) {
+			hd[minor].start_sect = this + p->start_sect;
+			hd[minor].nr_sects = p->nr_sects;
+			minor++;
+		}
+		p++;
+		if (!IS_EXTENDED(p->sys_ind) || !p->nr_sects) {
+			brelse(bh);
+			return;
+		}
+		this = first + p->start_sect;
+		brelse(bh);
+	}
+}
+
 /* This may be used only once, enforced by 'static int callable' */
 int sys_setup(void * BIOS)
 {
 	static int callable = 1;
 	int i,drive;
+	unsigned long ext;
 	unsigned char cmos_disks;
 	struct partition *p;
 	struct buffer_head * bh;
@@ -133,6 +326,10 @@ int sys_setup(void * BIOS)
 		hd[i*5].start_sect = 0;
 		hd[i*5].nr_sects = 0;
 	}
+	if (NR_HD)
+		hd_dma_init();
+	for (drive=0 ; drive<NR_HD ; drive++)
+		hd_identify(drive);
 	for (drive=0 ; drive<NR_HD ; drive++) {
 		if (!(bh = bread(0x300 + drive*5,0))) {
 			printk("Unable to read partition table of drive %d\n\r",
@@ -145,15 +342,22 @@ int sys_setup(void * BIOS)
 			panic("");
 		}
 		p = 0x1BE + (void *)bh->b_data;
+		ext = 0;
 		for (i=1;i<5;i++,p++) {
 			hd[i+5*drive].start_sect = p->start_sect;
 			hd[i+5*drive].nr_sects = p->nr_sects;
+			if (!ext && p->nr_sects && IS_EXTENDED(p->sys_ind))
+				ext = p->start_sect;
 		}
 		brelse(bh);
+		if (ext)
+			extended_partition(drive,ext);
 	}
 	if (NR_HD)
 		printk("Partition table%s ok.\n\r",(NR_HD>1)?"s":"");
 	rd_load();
+	if (MAJOR(SWAP_DEV) == 3 && MINOR(SWAP_DEV) < HD_MINORS)
+		init_swapping(hd[MINOR(SWAP_DEV)].nr_sects >> 1);
 	mount_root();
 	return (0);
 }
@@ -199,6 +403,49 @@ static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
 	outb(cmd,++port);
 }
 
+/*
+ * LBA drives get the sector number straight in the address registers,
+ * with the EXT commands the high order bytes go in first. The others
+ * still need the block turned into cylinder, head and sector.
+ */
+static void hd_out_block(unsigned int drive,unsigned int nsect,
+		unsigned long block,int mode,void (*intr_addr)(void))
+{
+	register int port asm("dx");
+	unsigned int sec,head,cyl;
+	int ext,w = (CURRENT->cmd == WRITE);
+
+	if (!hd_caps[drive].lba) {
+		__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
+			"r" (hd_info[drive].sect));
+		__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
+			"r" (hd_info[drive].head));
+		hd_out(drive,nsect,sec+1,head,cyl,hd_cmds[0][mode][w],intr_addr);
+		return;
+	}
+	ext = hd_caps[drive].lba48 && block+nsect > 0x10000000;
+	if (drive>1)
+		panic("Trying to write bad sector");
+	if (!controller_ready())
+		panic("HD controller not ready");
+	do_hd = intr_addr;
+	outb_p(hd_info[drive].ctl,HD_CMD);
+	if (ext) {
+		port=HD_NSECTOR;
+		outb_p(0,port);
+		outb_p(block>>24,++port);
+		outb_p(0,++port);
+		outb_p(0,++port);
+	}
+	port=HD_NSECTOR;
+	outb_p(nsect,port);
+	outb_p(block,++port);
+	outb_p(block>>8,++port);
+	outb_p(block>>16,++port);
+	outb_p(0xE0|(drive<<4)|(ext ? 0 : (block>>24) & 0x0f),++port);
+	outb(hd_cmds[ext][mode][w],++port);
+}
+
 static int drive_busy(void)
 {
 	unsigned int i;
@@ -229,7 +476,12 @@ static void reset_controller(void)
 
 static void reset_hd(int nr)
 {
+	int i;
+
 	reset_controller();
+	for (i = 0 ; i < NR_HD ; i++)
+		if (hd_caps[i].mult)
+			hd_caps[i].set_mult = 1;
 	hd_out(nr,hd_info[nr].sect,hd_info[nr].sect,hd_info[nr].head-1,
 		hd_info[nr].cyl,WIN_SPECIFY,&recal_intr);
 }
@@ -247,71 +499,176 @@ static void bad_rw_intr(void)
 		reset = 1;
 }
 
+/*
+ * Each interrupt brings a block of MULT sectors (or what is left of the
+ * request), which may run over several of the merged buffers.
+ */
 static void read_intr(void)
 {
+	int i;
+
+	nr_hd_intr++;
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	port_read(HD_DATA,CURRENT->buffer,256);
-	CURRENT->errors = 0;
-	CURRENT->buffer += 512;
-	CURRENT->sector++;
-	if (--CURRENT->nr_sectors) {
-		do_hd = &read_intr;
-		return;
+	for (i = MULT(CURRENT_DEV) ; i > 0 ; i--) {
+		port_read(HD_DATA,CURRENT->buffer,256);
+		CURRENT->errors = 0;
+		CURRENT->buffer += 512;
+		CURRENT->sector++;
+		CURRENT->current_nr_sectors--;
+		if (!--CURRENT->nr_sectors) {
+			end_request(1);
+			do_hd_request();
+			return;
+		}
+		if (!CURRENT->current_nr_sectors)
+			end_request(1);		/* on to the next merged block */
+	}
+	do_hd = &read_intr;
+}
+
+/*
+ * Writes go out a block at a time too. A block can run past the end of
+ * the current buffer, so here the chain is followed without ending the
+ * buffers: write_intr() does that once the drive says the block is done.
+ */
+static void hd_write_block(void)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	char * buf = CURRENT->buffer;
+	int left = CURRENT->current_nr_sectors;
+	int n = MULT(CURRENT_DEV);
+
+	if (n > CURRENT->nr_sectors)
+		n = CURRENT->nr_sectors;
+	hd_wcount = n;
+	while (n-- > 0) {
+		if (!left) {
+			bh = bh->b_reqnext;
+			buf = bh->b_data;
+			left = bh->b_size >> 9;
+		}
+		port_write(HD_DATA,buf,256);
+		buf += 512;
+		left--;
 	}
-	end_request(1);
-	do_hd_request();
 }
 
 static void write_intr(void)
 {
+	int i;
+
+	nr_hd_intr++;
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	if (--CURRENT->nr_sectors) {
+	for (i = hd_wcount ; i > 0 ; i--) {
+		CURRENT->current_nr_sectors--;
+		if (!--CURRENT->nr_sectors) {
+			end_request(1);
+			do_hd_request();
+			return;
+		}
 		CURRENT->sector++;
-		CURRENT->buffer += 512;
-		do_hd = &write_intr;
-		port_write(HD_DATA,CURRENT->buffer,256);
+		if (!CURRENT->current_nr_sectors)
+			end_request(1);		/* on to the next merged block */
+		else
+			CURRENT->buffer += 512;
+	}
+	do_hd = &write_intr;
+	hd_write_block();
+}
+
+/*
+ * Fill in the PRD table for the current request: one entry per buffer,
+ * or one for the page of a paging request. Buffers are aligned to their
+ * size, so none of them crosses a 64kB boundary.
+ */
+static void hd_dma_setup(void)
+{
+	struct buffer_head * bh;
+	unsigned long * prd = hd_prd;
+
+	*prd++ = (unsigned long) CURRENT->buffer;
+	*prd++ = CURRENT->current_nr_sectors << 9;
+	if (bh = CURRENT->bh)
+		while (bh = bh->b_reqnext) {
+			*prd++ = (unsigned long) bh->b_data;
+			*prd++ = bh->b_size;
+		}
+	prd[-1] |= BM_PRD_EOT;
+	outl((unsigned long) hd_prd,hd_bmide+BM_PRD);
+	outb(CURRENT->cmd == READ ? 8 : 0,hd_bmide+BM_COMMAND);
+	outb(inb(hd_bmide+BM_STATUS) | 6,hd_bmide+BM_STATUS);
+}
+
+/*
+ * The whole request is done with one interrupt. If DMA keeps failing
+ * the drive is put back to PIO for good.
+ */
+static void dma_intr(void)
+{
+	int st;
+
+	nr_hd_intr++;
+	st = inb(hd_bmide+BM_STATUS);
+	outb(inb(hd_bmide+BM_COMMAND) & ~1,hd_bmide+BM_COMMAND);
+	outb(st | 6,hd_bmide+BM_STATUS);
+	if (win_result() || (st & 2)) {
+		if (CURRENT->errors >= MAX_ERRORS/2) {
+			hd_caps[CURRENT_DEV].dma = 0;
+			printk("hd%c: DMA errors, using PIO\n\r",'a'+CURRENT_DEV);
+		}
+		bad_rw_intr();
+		do_hd_request();
 		return;
 	}
+	while (CURRENT->bh && CURRENT->bh->b_reqnext)
+		end_request(1);
 	end_request(1);
 	do_hd_request();
 }
 
 static void recal_intr(void)
 {
+	nr_hd_intr++;
 	if (win_result())
 		bad_rw_intr();
 	do_hd_request();
 }
 
+/* a drive that won't do SET MULTIPLE stays with single sectors */
+static void mult_intr(void)
+{
+	nr_hd_intr++;
+	if (win_result()) {
+		printk("hd%c: SET MULTIPLE failed\n\r",'a'+CURRENT_DEV);
+		hd_caps[CURRENT_DEV].mult = 0;
+	}
+	do_hd_request();
+}
+
 void do_hd_request(void)
 {
 	int i,r;
-	unsigned int block,dev;
-	unsigned int sec,head,cyl;
+	unsigned int dev;
+	unsigned long block;
 	unsigned int nsect;
 
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= HD_MINORS || block+CURRENT->nr_sectors > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
 	block += hd[dev].start_sect;
-	dev /= 5;
-	__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
-		"r" (hd_info[dev].sect));
-	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
-		"r" (hd_info[dev].head));
-	sec++;
+	dev = CURRENT_DEV;
 	nsect = CURRENT->nr_sectors;
 	if (reset) {
 		reset = 0;
@@ -325,19 +682,42 @@ void do_hd_request(void)
 			WIN_RESTORE,&recal_intr);
 		return;
 	}	
-	if (CURRENT->cmd == WRITE) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
+	if (hd_caps[dev].set_mult) {
+		hd_caps[dev].set_mult = 0;
+		hd_out(dev,hd_caps[dev].mult,0,0,0,WIN_SETMULT,&mult_intr);
+		return;
+	}
+	if (CURRENT->cmd != READ && CURRENT->cmd != WRITE)
+		panic("unknown hd-command");
+	nr_hd_cmds++;
+	nr_hd_sectors += nsect;
+	if (hd_caps[dev].dma) {
+		nr_hd_dma++;
+		hd_dma_setup();
+		hd_out_block(dev,nsect,block,HD_DMA,&dma_intr);
+		outb(inb(hd_bmide+BM_COMMAND) | 1,hd_bmide+BM_COMMAND);
+	} else if (CURRENT->cmd == WRITE) {
+		hd_out_block(dev,nsect,block,
+			hd_caps[dev].mult ? HD_MULT : HD_PIO,&write_intr);
+/* PIO writes have no interrupt for the first block: wait for DRQ */
 		for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
 			/* nothing */ ;
 		if (!r) {
 			bad_rw_intr();
 			goto repeat;
 		}
-		port_write(HD_DATA,CURRENT->buffer,256);
-	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+		hd_write_block();
 	} else
-		panic("unknown hd-command");
+		hd_out_block(dev,nsect,block,
+			hd_caps[dev].mult ? HD_MULT : HD_PIO,&read_intr);
+}
+
+void show_hd_stats(void)
+{
+	if (!NR_HD)
+		return;
+	printk("hd: %d commands (%d by DMA), %d sectors, %d interrupts\n\r",
+		   nr_hd_cmds, nr_hd_dma, nr_hd_sectors, nr_hd_intr);
 }
 
 void hd_init(void)
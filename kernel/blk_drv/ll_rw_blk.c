@@ -8,6 +8,7 @@
  * This handles all read/write requests to block devices
  */
 #include <errno.h>
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
@@ -25,9 +26,15 @@ struct request request[NR_REQUEST];
  */
 struct task_struct *wait_for_request = NULL;
 
+/* statistics, see show_blk_stats() */
+static unsigned long nr_requests = 0;
+static unsigned long nr_merged = 0;
+
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
+ *	elevator (set up by blk_dev_init)
+ *	latency histogram
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 	{NULL, NULL}, /* no_dev */
@@ -76,16 +83,72 @@ static void add_request(struct blk_dev_struct *dev, struct request *req)
 		(dev->request_fn)();
 		return;
 	}
-	for (; tmp->next; tmp = tmp->next)
-		if ((IN_ORDER(tmp, req) ||
-			 !IN_ORDER(tmp, tmp->next)) &&
-			IN_ORDER(req, tmp->next))
-			break;
-	req->next = tmp->next;
-	tmp->next = req;
+	(dev->elevator->add)(tmp, req);
 	sti();
 }
 
+/*
+ * Called by end_request() when the request at the head of the queue is
+ * done: account for its latency, let the elevator pick the next one,
+ * and return it as the new head.
+ */
+struct request *next_request(struct blk_dev_struct *dev)
+{
+	struct request *req = dev->current_request;
+	unsigned long t = jiffies - req->start_time;
+	int i;
+
+	for (i = 0; t && i < NR_LATENCY - 1; i++)
+		t >>= 1;
+	dev->latency[i]++;
+	if (req->next && dev->elevator->next)
+		(dev->elevator->next)(req);
+	req->dev = -1;
+	return req->next;
+}
+
+/*
+ * Try to add the buffer to a queued request for the blocks right before
+ * or after it. The first request in the queue is left alone, as the
+ * driver may already have started on it. Called with interrupts off.
+ */
+static int merge_request(struct blk_dev_struct *dev, int rw, struct buffer_head *bh)
+{
+	struct request *req;
+	unsigned long nr = bh->b_size >> 9;
+	unsigned long sector = bh->b_blocknr * nr;
+
+	if (!(req = dev->current_request))
+		return 0;
+	while ((req = req->next) != NULL)
+	{
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh ||
+			req->nr_sectors + nr > MAX_SECTORS)
+			continue;
+		if (req->sector + req->nr_sectors == sector)
+		{
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+		}
+		else if (req->sector == sector + nr)
+		{
+			bh->b_reqnext = req->bh;
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->sector = sector;
+			req->current_nr_sectors = nr;
+		}
+		else
+			continue;
+		req->nr_sectors += nr;
+		if (rw == WRITE)
+			bh->b_dirt = 0;
+		nr_merged++;
+		return 1;
+	}
+	return 0;
+}
+
 static void make_request(int major, int rw, struct buffer_head *bh)
 {
 	struct request *req;
@@ -110,6 +173,14 @@ static void make_request(int major, int rw, struct buffer_head *bh)
 		unlock_buffer(bh);
 		return;
 	}
+	bh->b_reqnext = NULL;
+	cli();
+	if (merge_request(major + blk_dev, rw, bh))
+	{
+		sti();
+		return;
+	}
+	sti();
 repeat:
 	/* we don't allow the write-requests to fill up the queue completely:
 	 * we want some room for reads: they take precedence. The last third
@@ -138,12 +209,16 @@ repeat:
 	req->dev = bh->b_dev;
 	req->cmd = rw;
 	req->errors = 0;
-	req->sector = bh->b_blocknr << 1;
-	req->nr_sectors = 2;
+	req->nr_sectors = bh->b_size >> 9;
+	req->current_nr_sectors = req->nr_sectors;
+	req->sector = bh->b_blocknr * req->nr_sectors;
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
+	req->bhtail = bh;
+	req->start_time = jiffies;
 	req->next = NULL;
+	nr_requests++;
 	add_request(major + blk_dev, req);
 }
 
@@ -160,13 +235,95 @@ void ll_rw_block(int rw, struct buffer_head *bh)
 	make_request(major, rw, bh);
 }
 
+/*
+ * Read or write a whole page, for swapping. This doesn't go through the
+ * buffer cache at all: the request has no buffer heads, end_request()
+ * just wakes us up when the 8 sectors are done.
+ */
+void ll_rw_page(int rw, int dev, int page, char *buffer)
+{
+	struct request *req;
+	unsigned int major = MAJOR(dev);
+
+	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn))
+	{
+		printk("Trying to read nonexistent block-device\n\r");
+		return;
+	}
+	if (rw != READ && rw != WRITE)
+		panic("Bad block dev command, must be R/W");
+repeat:
+	req = request + NR_REQUEST;
+	while (--req >= request)
+		if (req->dev < 0)
+			break;
+	if (req < request)
+	{
+		sleep_on(&wait_for_request);
+		goto repeat;
+	}
+	req->dev = dev;
+	req->cmd = rw;
+	req->errors = 0;
+	req->sector = page << 3;
+	req->nr_sectors = 8;
+	req->current_nr_sectors = 8;
+	req->buffer = buffer;
+	req->waiting = current;
+	req->bh = NULL;
+	req->bhtail = NULL;
+	req->start_time = jiffies;
+	req->next = NULL;
+	nr_requests++;
+	current->state = TASK_UNINTERRUPTIBLE;
+	add_request(major + blk_dev, req);
+	schedule();
+}
+
+#ifdef IOSCHED_TABLE
+static struct
+{
+	int major;
+	const char *name;
+} iosched_table[] = {IOSCHED_TABLE};
+#endif
+
 void blk_dev_init(void)
 {
 	int i;
+	struct elevator *e;
 
 	for (i = 0; i < NR_REQUEST; i++)
 	{
 		request[i].dev = -1;
 		request[i].next = NULL;
 	}
+	for (i = 0; i < NR_BLK_DEV; i++)
+		blk_dev[i].elevator = find_elevator("elevator");
+#ifdef IOSCHED_TABLE
+	for (i = 0; i < sizeof(iosched_table) / sizeof(iosched_table[0]); i++)
+		if (iosched_table[i].major >= NR_BLK_DEV ||
+			!(e = find_elevator(iosched_table[i].name)))
+			printk("blk_dev_init: bad iosched entry %d\n\r", i);
+		else
+			blk_dev[iosched_table[i].major].elevator = e;
+#endif
+}
+
+void show_blk_stats(void)
+{
+	int i;
+	unsigned long *l;
+
+	printk("block requests: %d issued, %d blocks merged into them\n\r",
+		   nr_requests, nr_merged);
+	for (i = 0; i < NR_BLK_DEV; i++)
+	{
+		if (!blk_dev[i].request_fn)
+			continue;
+		l = blk_dev[i].latency;
+		printk("major %d (%s) latency: %d %d %d %d %d %d %d %d\n\r",
+			   i, blk_dev[i].elevator->name,
+			   l[0], l[1], l[2], l[3], l[4], l[5], l[6], l[7]);
+	}
 }
@@ -115,8 +115,10 @@ void tty_intr(struct tty_struct * tty, int mask)
 	if (tty->pgrp <= 0)
 		return;
 	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
+		if (task[i] && task[i]->pgrp==tty->pgrp) {
 			task[i]->signal |= mask;
+			signal_wake_up(task[i]);
+		}
 }
 
 static void sleep_if_empty(struct tty_queue * queue)
@@ -227,11 +229,19 @@ void copy_to_cooked(struct tty_struct * tty)
 	wake_up(&tty->secondary.proc_list);
 }
 
+/*
+ * tty_read() and tty_write() still have to look at every character, but
+ * they collect them in a small buffer on the kernel stack, so that user
+ * space is only touched with memcpy_tofs()/memcpy_fromfs().
+ */
+#define TTY_COPY_BUF 64
+
 int tty_read(unsigned channel, char * buf, int nr)
 {
 	struct tty_struct * tty;
 	char c, * b=buf;
-	int minimum,time,flag=0;
+	char tmp[TTY_COPY_BUF];
+	int minimum,time,flag=0,n=0;
 	long oldalarm;
 
 	if (channel>2 || nr<0) return -1;
@@ -242,7 +252,7 @@ int tty_read(unsigned channel, char * buf, int nr)
 	if (time && !minimum) {
 		minimum=1;
 		if (flag=(!oldalarm || time+jiffies<oldalarm))
-			current->alarm = time+jiffies;
+			set_alarm(current,time+jiffies);
 	}
 	if (minimum>nr)
 		minimum=nr;
@@ -262,26 +272,35 @@ int tty_read(unsigned channel, char * buf, int nr)
 			GETCH(tty->secondary,c);
 			if (c==EOF_CHAR(tty) || c==10)
 				tty->secondary.data--;
-			if (c==EOF_CHAR(tty) && L_CANON(tty))
-				return (b-buf);
-			else {
-				put_fs_byte(c,b++);
+			if (c==EOF_CHAR(tty) && L_CANON(tty)) {
+				memcpy_tofs(b,tmp,n);
+				return (b+n-buf);
+			} else {
+				tmp[n++] = c;
+				if (n == TTY_COPY_BUF) {
+					memcpy_tofs(b,tmp,n);
+					b += n;
+					n = 0;
+				}
 				if (!--nr)
 					break;
 			}
 		} while (nr>0 && !EMPTY(tty->secondary));
+		memcpy_tofs(b,tmp,n);
+		b += n;
+		n = 0;
 		if (time && !L_CANON(tty))
 			if (flag=(!oldalarm || time+jiffies<oldalarm))
-				current->alarm = time+jiffies;
+				set_alarm(current,time+jiffies);
 			else
-				current->alarm = oldalarm;
+				set_alarm(current,oldalarm);
 		if (L_CANON(tty)) {
 			if (b-buf)
 				break;
 		} else if (b-buf >= minimum)
 			break;
 	}
-	current->alarm = oldalarm;
+	set_alarm(current,oldalarm);
 	if (current->signal && !(b-buf))
 		return -EINTR;
 	return (b-buf);
@@ -292,6 +311,8 @@ int tty_write(unsigned channel, char * buf, int nr)
 	static cr_flag=0;
 	struct tty_struct * tty;
 	char c, *b=buf;
+	char tmp[TTY_COPY_BUF];
+	int i=0,n=0;
 
 	if (channel>2 || nr<0) return -1;
 	tty = channel + tty_table;
@@ -300,7 +321,12 @@ int tty_write(unsigned channel, char * buf, int nr)
 		if (current->signal)
 			break;
 		while (nr>0 && !FULL(tty->write_q)) {
-			c=get_fs_byte(b);
+			if (i >= n) {
+				n = (nr < TTY_COPY_BUF) ? nr : TTY_COPY_BUF;
+				memcpy_fromfs(tmp,b,n);
+				i = 0;
+			}
+			c=tmp[i];
 			if (O_POST(tty)) {
 				if (c=='\r' && O_CRNL(tty))
 					c='\n';
@@ -314,7 +340,7 @@ int tty_write(unsigned channel, char * buf, int nr)
 				if (O_LCUC(tty))
 					c=toupper(c);
 			}
-			b++; nr--;
+			b++; nr--; i++;
 			cr_flag = 0;
 			PUTCH(c,tty->write_q);
 		}
@@ -39,6 +39,7 @@ void release(struct task_struct *p)
 		if (task[i] == p)
 		{
 			task[i] = NULL;
+			free_page(p->tss.cr3); //页目录: 进程退出后才能释放
 			free_page((long)p); //释放内存页
 			schedule();			//重新进行进程调度
 			return;
@@ -51,7 +52,10 @@ static inline int send_sig(long sig, struct task_struct *p, int priv)
 	if (!p || sig < 1 || sig > 32)
 		return -EINVAL;
 	if (priv || (current->euid == p->euid) || suser())
+	{
 		p->signal |= (1 << (sig - 1));
+		signal_wake_up(p);
+	}
 	else
 		return -EPERM;
 	return 0;
@@ -65,7 +69,10 @@ static void kill_session(void)
 	while (--p > &FIRST_TASK)
 	{ //从最后一个开始扫描（不包括0进程）
 		if (*p && (*p)->session == current->session)
+		{
 			(*p)->signal |= 1 << (SIGHUP - 1);
+			signal_wake_up(*p);
+		}
 	}
 }
 
@@ -118,6 +125,7 @@ static void tell_father(int pid)
 			if (task[i]->pid != pid)
 				continue;
 			task[i]->signal |= (1 << (SIGCHLD - 1)); //找到父亲发送SIGCHLD信号
+			signal_wake_up(task[i]);
 			return;
 		}
 	/* if we don't find any fathers, we just release ourselves */
@@ -131,8 +139,9 @@ int do_exit(long code)
 {
 	int i;
 	//释放内存页
-	free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+	free_page_tables(task_dir(current), get_base(current->ldt[1]), get_limit(0x0f));
+	free_page_tables(task_dir(current), get_base(current->ldt[2]), get_limit(0x17));
+	vfork_release();
 	// current->pid就是当前需要关闭的进程
 	for (i = 0; i < NR_TASKS; i++)
 		if (task[i] && task[i]->father == current->pid)
@@ -157,6 +166,7 @@ int do_exit(long code)
 		last_task_used_math = NULL; //清空协处理器
 	if (current->leader)
 		kill_session();			  //清空session
+	set_alarm(current, 0);
 	current->state = TASK_ZOMBIE; //设为僵死状态
 	current->exit_code = code;
 	tell_father(current->father);
@@ -11,6 +11,7 @@
  * management can be a bitch. See 'mm/mm.c': 'copy_page_tables()'
  */
 #include <errno.h>
+#include <string.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -40,10 +41,12 @@ void verify_area(void * addr,int size)
 }
 // 对内存拷贝
 // 主要作用就是把代码段数据段等栈上的数据拷贝一份
-int copy_mem(int nr,struct task_struct * p)
+// clone_vm: vfork(), the child uses the parent's memory as it is
+int copy_mem(int nr,struct task_struct * p,int clone_vm)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
 	unsigned long old_code_base,new_code_base,code_limit;
+	unsigned long *dir;
 
 	code_limit=get_limit(0x0f);
 	data_limit=get_limit(0x17);
@@ -53,12 +56,19 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000;
+	new_data_base = new_code_base = TASK_BASE;
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);
+/* a page directory of our own, with the kernel part copied over */
+	if (!(dir = (unsigned long *) get_free_page()))
+		return -ENOMEM;
+	memcpy(dir,pg_dir,(TASK_BASE >> 22) * sizeof(unsigned long));
+	p->tss.cr3 = (long) dir;
+	if ((clone_vm ? share_page_tables : copy_page_tables)
+			(dir,old_data_base,new_data_base,data_limit)) {
+		free_page_tables(dir,new_data_base,data_limit);
+		free_page((long) dir);
 		return -ENOMEM;
 	}
 	return 0;
@@ -74,27 +84,43 @@ int copy_mem(int nr,struct task_struct * p)
 // 除此之外还要对栈堆拷贝 当进程做创建的时候要复制原有的栈堆
 // nr就是刚刚找到的空槽的pid
 // 拷贝了父进程的数据段，继承了父进程打开文件的数量
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+int copy_process(int clone_vm,int nr,long ebp,long edi,long esi,long gs,long none,
 		long ebx,long ecx,long edx,
 		long fs,long es,long ds,
 		long eip,long cs,long eflags,long esp,long ss)
 {
 	struct task_struct *p;
-	int i;
+	int i, pid = last_pid;	/* before anything can sleep */
 	struct file *f;
 	//其实就是malloc分配内存
 	p = (struct task_struct *) get_free_page();//在内存分配一个空白页，让指针指向它
 	if (!p)
 		return -EAGAIN;//如果分配失败就是返回错误
+/* get_free_page() may have slept, and another fork taken our slot */
+	if (task[nr]) {
+		for (nr = 1 ; nr < NR_TASKS && task[nr] ; nr++)
+			/* nothing */;
+		if (nr == NR_TASKS) {
+			free_page((long) p);
+			return -EAGAIN;
+		}
+	}
 	task[nr] = p;//把这个指针放入进程的链表当中
 	*p = *current;//把当前进程赋给p，也就是拷贝一份	/* NOTE! this doesn't copy the supervisor stack */
 	//后面全是对这个结构体进行赋值相当于初始化赋值
 	p->state = TASK_UNINTERRUPTIBLE;
-	p->pid = last_pid;
+	p->pid = pid;
 	p->father = current->pid;
 	p->counter = p->priority;
 	p->signal = 0;
 	p->alarm = 0;
+	init_timer(&p->alarm_timer);
+	p->nr = nr;
+	p->array = NULL;
+	p->run_next = NULL;
+	p->epoch = sched_epoch;
+	p->vforked = clone_vm;
+	p->vfork_wait = NULL;
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
@@ -122,7 +148,7 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.trace_bitmap = 0x80000000;
 	if (last_task_used_math == current)//如果使用了就设置协处理器
 		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
-	if (copy_mem(nr,p)) {//老进程向新进程代码段和数据段进行拷贝
+	if (copy_mem(nr,p,clone_vm)) {//老进程向新进程代码段和数据段进行拷贝
 		task[nr] = NULL;//如果失败了
 		free_page((long) p);//就释放当前页
 		return -EAGAIN;
@@ -138,8 +164,23 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		current->executable->i_count++;
 	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
 	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
-	p->state = TASK_RUNNING;//把状态设定为运行状态	/* do this last, just in case */
-	return last_pid;//返回新创建进程的id号
+	wake_up_process(p);//把状态设定为运行状态	/* do this last, just in case */
+/* vfork(): we can't run on our memory until the child gives it back */
+	while (p->vforked)
+		sleep_on(&p->vfork_wait);
+	return pid;//返回新创建进程的id号
+}
+
+/*
+ * A vfork()ed child calls this when it stops using its parent's memory,
+ * from execve() or exit().
+ */
+void vfork_release(void)
+{
+	if (!current->vforked)
+		return;
+	current->vforked = 0;
+	wake_up(&current->vfork_wait);
 }
 
 //大概意思就是一直循环重复找，直到找到一个空的位置
@@ -20,6 +20,17 @@
 
 #include <signal.h>
 
+extern void show_blk_stats(void);
+extern void show_hd_stats(void);
+extern void show_pipe_stats(void);
+extern void show_text_cache(void);
+extern void show_free_pages(void);
+extern void show_page_tables(void);
+extern void show_swap(void);
+
+static unsigned long nr_switches = 0;
+static unsigned long nr_epochs = 0;
+
 #define _S(nr) (1 << ((nr)-1))
 #define _BLOCKABLE (~(_S(SIGKILL) | _S(SIGSTOP)))
 // nr就是pid
@@ -43,6 +54,18 @@ void show_stat(void)
 	for (i = 0; i < NR_TASKS; i++)
 		if (task[i])
 			show_task(i, task[i]);
+	show_buffers();
+	show_inodes();
+	show_dcache();
+	show_blk_stats();
+	show_hd_stats();
+	show_pipe_stats();
+	show_text_cache();
+	show_free_pages();
+	show_page_tables();
+	show_swap();
+	printk("sched: %d context switches, %d counter epochs\n\r",
+		   nr_switches, nr_epochs);
 }
 
 #define LATCH (1193180 / HZ)
@@ -107,10 +130,142 @@ void math_state_restore()
 }
 
 /*
- *  'schedule()' is the scheduler function. This is GOOD CODE! There
- * probably won't be any reason to change this, as it should work well
- * in all circumstances (ie gives IO-bound processes good response etc).
- * The one thing you might take a look at is the signal-handler code here.
+ * The run queue. Every runnable task except the one running (and task 0,
+ * which runs when nothing else can) is on one of NR_PRIO lists of the
+ * active array, indexed by its counter, so the task with the biggest
+ * counter is found with a single bsrl on the bitmap. Tasks whose counter
+ * has run out go to the expired array, and when the active array is empty
+ * the two are swapped. That swap is the old "counter = counter/2 +
+ * priority" pass over all tasks: instead of walking task[], sched_epoch is
+ * bumped, and every task catches up on the passes it missed the next time
+ * it is queued or picked. Nothing here depends on the number of tasks.
+ *
+ * All of this is done with interrupts off, as wake_up() can be called
+ * from interrupt handlers.
+ */
+#define NR_PRIO 32
+
+struct prio_array
+{
+	unsigned long bitmap;
+	struct task_struct *head[NR_PRIO], *tail[NR_PRIO];
+};
+
+static struct prio_array prio_arrays[2];
+static struct prio_array *active = prio_arrays;
+static struct prio_array *expired = prio_arrays + 1;
+unsigned long sched_epoch = 0;
+
+static inline int highest_prio(unsigned long bitmap)
+{
+	int n;
+
+	__asm__("bsrl %1,%0"
+			: "=r"(n)
+			: "r"(bitmap));
+	return n;
+}
+
+/* the counter recalculations missed while asleep or expired */
+static inline void catch_up(struct task_struct *p)
+{
+	unsigned long n = sched_epoch - p->epoch;
+
+	if (n > 8) /* counter has converged to ~2*priority by then */
+		n = 8;
+	while (n--)
+		p->counter = (p->counter >> 1) + p->priority;
+	p->epoch = sched_epoch;
+}
+
+static void enqueue_task(struct task_struct *p)
+{
+	struct prio_array *array;
+	int prio;
+
+	catch_up(p);
+	if (p->counter > 0)
+	{
+		array = active;
+		prio = p->counter;
+	}
+	else
+	{ /* this is what its counter will be after the next swap */
+		array = expired;
+		prio = p->priority;
+	}
+	if (prio >= NR_PRIO)
+		prio = NR_PRIO - 1;
+	p->run_next = NULL;
+	if (array->tail[prio])
+		array->tail[prio]->run_next = p;
+	else
+		array->head[prio] = p;
+	array->tail[prio] = p;
+	array->bitmap |= 1 << prio;
+	p->array = array;
+}
+
+static struct task_struct *pick_next_task(void)
+{
+	struct prio_array *array;
+	struct task_struct *p;
+	int prio;
+
+	if (!active->bitmap)
+	{
+		if (!expired->bitmap)
+			return task[0];
+		array = active;
+		active = expired;
+		expired = array;
+		sched_epoch++;
+		nr_epochs++;
+	}
+	prio = highest_prio(active->bitmap);
+	p = active->head[prio];
+	if (!(active->head[prio] = p->run_next))
+	{
+		active->tail[prio] = NULL;
+		active->bitmap &= ~(1 << prio);
+	}
+	p->run_next = NULL;
+	p->array = NULL;
+	catch_up(p);
+	return p;
+}
+
+/*
+ * Make a task runnable. The running task is not on the run queue,
+ * schedule() puts it back if it is still runnable.
+ */
+void wake_up_process(struct task_struct *p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p != current && p != task[0] && !p->array)
+		enqueue_task(p);
+	restore_flags(flags);
+}
+
+/*
+ * Called after a signal has been posted to p. schedule() used to check
+ * every task for this, now whoever sends the signal has to.
+ */
+void signal_wake_up(struct task_struct *p)
+{
+	if (p->state == TASK_INTERRUPTIBLE &&
+		(p->signal & ~(_BLOCKABLE & p->blocked)))
+		wake_up_process(p);
+}
+
+/*
+ *  'schedule()' is the scheduler function. It picks the runnable task
+ * with the biggest counter, like it always did, but from the run queue
+ * above instead of scanning all of task[].
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
@@ -119,57 +274,33 @@ void math_state_restore()
 // 时间片分配
 void schedule(void)
 {
-	int i, next, c;
-	struct task_struct **p;
-
-	/* check alarm, wake up any interruptible tasks that have got a signal */
-
-	for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-		if (*p)
-		{											  // alarm是用来设置警告，比如jiffies有1000个可能其中一些需要警告那么就用alarm来实现
-			if ((*p)->alarm && (*p)->alarm < jiffies) // alarm存在，并且已经到点
-			{
-				(*p)->signal |= (1 << (SIGALRM - 1)); //新增一个警告信号量
-				(*p)->alarm = 0;					  //警告清空
-			}
-			//~(_BLOCKABLE & (*p)->blocked
-			//用来排除非阻塞信号
-			//如果该进程为可中断睡眠状态 则如果该进程有非屏蔽信号出现就将该进程的状态设置为running
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-				(*p)->state == TASK_INTERRUPTIBLE) //并且状态是可中断的
-				(*p)->state = TASK_RUNNING;
-		}
-
-	/* this is the scheduler proper: */
-	// 以下思路，循环task列表 根据counter大小决定进程切换
-	while (1)
-	{
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		while (--i)
-		{
-			if (!*--p)
-				continue;										  //进程为空就继续循环
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c) //找出c最大的task
-				c = (*p)->counter, next = i;
-		}
-		if (c)
-			break; //如果c找到了，就终结循环，说明找到了
-		//进行时间片的重新分配
-		for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-			if (*p) //这里很关键，在低版本内核中，是进行优先级时间片轮转分配，这里搞清楚了优先级和时间片的关系
-					// counter = counter/2 + priority
-				(*p)->counter = ((*p)->counter >> 1) +
-								(*p)->priority;
-	}
+	struct task_struct *next;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	/* a signal may have arrived before we got to sleep */
+	if (current->state == TASK_INTERRUPTIBLE &&
+		(current->signal & ~(_BLOCKABLE & current->blocked)))
+		current->state = TASK_RUNNING;
+	if (current->state == TASK_RUNNING && current != task[0])
+		enqueue_task(current);
+	next = pick_next_task();
+	if (next != current)
+		nr_switches++;
 	//切换到下一个进程 这个功能使用宏定义完成的
-	switch_to(next);
+	switch_to(next->nr);
+	restore_flags(flags);
 }
 
+/*
+ * Task 0 calls pause() whenever it gets to run, ie when nobody else wants
+ * the cpu, which makes this the place to clear free pages in advance.
+ */
 int sys_pause(void)
 {
+	if (current == task[0])
+		refill_zero_pages();
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	return 0;
@@ -214,7 +345,7 @@ void sleep_on(struct task_struct **p)
 
 	// 若在其前还有存在的等待的任务，则也将其置为就绪状态(唤醒).
 	if (tmp)
-		tmp->state = 0;
+		wake_up_process(tmp);
 }
 
 void interruptible_sleep_on(struct task_struct **p)
@@ -232,19 +363,19 @@ repeat:
 	schedule();
 	if (*p && *p != current)
 	{
-		(**p).state = 0;
+		wake_up_process(*p);
 		goto repeat;
 	}
 	*p = NULL;
 	if (tmp)
-		tmp->state = 0;
+		wake_up_process(tmp);
 }
 
 void wake_up(struct task_struct **p)
 {
 	if (p && *p)
 	{
-		(**p).state = 0;
+		wake_up_process(*p);
 		*p = NULL;
 	}
 }
@@ -255,19 +386,43 @@ void wake_up(struct task_struct **p)
  * was the easiest way of doing it.
  */
 static struct task_struct *wait_motor[4] = {NULL, NULL, NULL, NULL};
-static int mon_timer[4] = {0, 0, 0, 0};
-static int moff_timer[4] = {0, 0, 0, 0};
+static struct timer_list motor_on_timer[4];
+static struct timer_list motor_off_timer[4];
 unsigned char current_DOR = 0x0C;
 
+static void motor_on_callback(unsigned long nr)
+{
+	wake_up(nr + wait_motor);
+}
+
+static void motor_off_callback(unsigned long nr)
+{
+	unsigned char mask = 0x10 << nr;
+
+	if (!(mask & current_DOR))
+		return;
+	if (timer_pending(motor_on_timer + nr))
+	{ /* still spinning up, count from when it's done */
+		mod_timer(motor_off_timer + nr, motor_on_timer[nr].expires + 3 * HZ);
+		return;
+	}
+	current_DOR &= ~mask;
+	outb(current_DOR, FD_DOR);
+}
+
 int ticks_to_floppy_on(unsigned int nr)
 {
 	extern unsigned char selected;
 	unsigned char mask = 0x10 << nr;
+	long ticks;
 
 	if (nr > 3)
 		panic("floppy_on: nr>3");
-	moff_timer[nr] = 10000; /* 100 s = very big :-) */
-	cli();					/* use floppy_off to turn it off */
+	mod_timer(motor_off_timer + nr, jiffies + 10000); /* 100 s = very big :-) */
+	cli();											  /* use floppy_off to turn it off */
+	ticks = 0;
+	if (timer_pending(motor_on_timer + nr))
+		ticks = motor_on_timer[nr].expires - jiffies;
 	mask |= current_DOR;
 	if (!selected)
 	{
@@ -278,13 +433,14 @@ int ticks_to_floppy_on(unsigned int nr)
 	{
 		outb(mask, FD_DOR);
 		if ((mask ^ current_DOR) & 0xf0)
-			mon_timer[nr] = HZ / 2;
-		else if (mon_timer[nr] < 2)
-			mon_timer[nr] = 2;
+			ticks = HZ / 2;
+		else if (ticks < 2)
+			ticks = 2;
 		current_DOR = mask;
+		mod_timer(motor_on_timer + nr, jiffies + ticks);
 	}
 	sti();
-	return mon_timer[nr];
+	return ticks;
 }
 
 void floppy_on(unsigned int nr)
@@ -297,75 +453,33 @@ void floppy_on(unsigned int nr)
 
 void floppy_off(unsigned int nr)
 {
-	moff_timer[nr] = 3 * HZ;
+	mod_timer(motor_off_timer + nr, jiffies + 3 * HZ);
 }
 
-void do_floppy_timer(void)
+/*
+ * Alarms are per-task timers. They go off once jiffies has passed
+ * p->alarm, hence the +1.
+ */
+static void alarm_timeout(unsigned long data)
 {
-	int i;
-	unsigned char mask = 0x10;
+	struct task_struct *p = (struct task_struct *)data;
 
-	for (i = 0; i < 4; i++, mask <<= 1)
-	{
-		if (!(mask & current_DOR))
-			continue;
-		if (mon_timer[i])
-		{
-			if (!--mon_timer[i])
-				wake_up(i + wait_motor);
-		}
-		else if (!moff_timer[i])
-		{
-			current_DOR &= ~mask;
-			outb(current_DOR, FD_DOR);
-		}
-		else
-			moff_timer[i]--;
-	}
+	p->alarm = 0;
+	p->signal |= (1 << (SIGALRM - 1));
+	signal_wake_up(p);
 }
 
-#define TIME_REQUESTS 64
-
-static struct timer_list
-{
-	long jiffies;
-	void (*fn)();
-	struct timer_list *next;
-} timer_list[TIME_REQUESTS], *next_timer = NULL;
-
-void add_timer(long jiffies, void (*fn)(void))
+void set_alarm(struct task_struct *p, long when)
 {
-	struct timer_list *p;
-
-	if (!fn)
-		return;
-	cli();
-	if (jiffies <= 0)
-		(fn)();
-	else
+	p->alarm = when;
+	if (!when)
 	{
-		for (p = timer_list; p < timer_list + TIME_REQUESTS; p++)
-			if (!p->fn)
-				break;
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more time requests free");
-		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-		while (p->next && p->next->jiffies < p->jiffies)
-		{
-			p->jiffies -= p->next->jiffies;
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
-		}
+		del_timer(&p->alarm_timer);
+		return;
 	}
-	sti();
+	p->alarm_timer.function = alarm_timeout;
+	p->alarm_timer.data = (unsigned long)p;
+	mod_timer(&p->alarm_timer, when + 1);
 }
 
 void do_timer(long cpl)
@@ -382,22 +496,8 @@ void do_timer(long cpl)
 	else
 		current->stime++; //内核程序运行时间+1
 
-	if (next_timer)
-	{ // next_timer 是连接jiffies变量的所有定时器的事件链表
-		// 可以这样想象，jiffies是一个时间轴，然后这个时间轴上每个绳结上绑了一个事件，运行到该绳结就触发对应的事件
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0)
-		{
-			void (*fn)(void);
-
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();
-		}
-	}
-	if (current_DOR & 0xf0) //取高四位
-		do_floppy_timer();
+	// 定时器（包括alarm和软驱马达）都挂在timer.c的时间轮上
+	run_timers();
 	if ((--current->counter) > 0)
 		return;
 	current->counter = 0; // counter进程的时间片为0，task_struct[]是进程的向量表
@@ -414,7 +514,7 @@ int sys_alarm(long seconds)
 
 	if (old)
 		old = (old - jiffies) / HZ;
-	current->alarm = (seconds > 0) ? (jiffies + HZ * seconds) : 0;
+	set_alarm(current, (seconds > 0) ? (jiffies + HZ * seconds) : 0);
 	return (old);
 }
 
@@ -485,6 +585,15 @@ void sched_init(void)
 	outb_p(0x36, 0x43);			/* binary, mode 3, LSB/MSB, ch 0 */
 	outb_p(LATCH & 0xff, 0x40); /* LSB */
 	outb(LATCH >> 8, 0x40);		/* MSB */
+	for (i = 0; i < 4; i++)
+	{
+		init_timer(motor_on_timer + i);
+		motor_on_timer[i].function = motor_on_callback;
+		motor_on_timer[i].data = i;
+		init_timer(motor_off_timer + i);
+		motor_off_timer[i].function = motor_off_callback;
+		motor_off_timer[i].data = i;
+	}
 	set_intr_gate(0x20, &timer_interrupt);
 	outb(inb_p(0x21) & ~0x01, 0x21);
 	//设置系统中断
@@ -0,0 +1,131 @@
+/*
+ *  linux/kernel/timer.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * A hierarchical timing wheel. Timers due in the next 256 ticks hang off
+ * tv1, one list per tick. Further out they go into one of four coarser
+ * wheels of 64 lists each, and whenever tv1 has gone round once, the
+ * next list of the wheel above is emptied back into the finer ones
+ * ("cascading"). So arming and cancelling a timer are O(1), and the timer
+ * interrupt only ever looks at the timers that are actually due.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/timer.h>
+#include <asm/system.h>
+
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define NR_TVN 4
+
+static struct timer_list * tv1[TVR_SIZE];
+static struct timer_list * tvn[NR_TVN][TVN_SIZE];
+static unsigned long timer_jiffies = 0;	/* next tick to run timers for */
+
+static void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** vec;
+	int i;
+
+	if ((long) idx < 0)		/* already due, run it on the next tick */
+		vec = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx < TVR_SIZE)
+		vec = tv1 + (expires & TVR_MASK);
+	else {
+		for (i = 0 ; i < NR_TVN-1 ; i++)
+			if (idx < 1UL << (TVR_BITS + (i+1)*TVN_BITS))
+				break;
+		vec = tvn[i] + ((expires >> (TVR_BITS + i*TVN_BITS)) & TVN_MASK);
+	}
+	if ((timer->next = *vec) != NULL)
+		(*vec)->pprev = &timer->next;
+	*vec = timer;
+	timer->pprev = vec;
+}
+
+static inline void detach_timer(struct timer_list * timer)
+{
+	if ((*timer->pprev = timer->next) != NULL)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+void init_timer(struct timer_list * timer)
+{
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+void mod_timer(struct timer_list * timer, unsigned long expires)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer->pprev)
+		detach_timer(timer);
+	timer->expires = expires;
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	save_flags(flags);
+	cli();
+	if (timer->pprev) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+static void cascade(struct timer_list ** vec)
+{
+	struct timer_list * timer = *vec, * next;
+
+	*vec = NULL;
+	while (timer) {
+		next = timer->next;
+		internal_add_timer(timer);
+		timer = next;
+	}
+}
+
+/*
+ * Called from do_timer(), with interrupts off.
+ */
+void run_timers(void)
+{
+	struct timer_list * timer;
+	int index, n, i;
+
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		index = timer_jiffies & TVR_MASK;
+		for (n = 0 ; !index && n < NR_TVN ; n++) {
+			i = (timer_jiffies >> (TVR_BITS + n*TVN_BITS)) & TVN_MASK;
+			cascade(tvn[n] + i);
+			if (i)
+				break;
+		}
+		while ((timer = tv1[index]) != NULL) {
+			detach_timer(timer);
+			timer->function(timer->data);
+		}
+		timer_jiffies++;
+	}
+}
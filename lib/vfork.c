@@ -0,0 +1,30 @@
+/*
+ *  linux/lib/vfork.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+
+/*
+ * vfork() can't be a normal _syscall0(): the child runs on our stack
+ * until it calls execve() or _exit(), and would write all over our
+ * return address. So it is taken off the stack before the system call,
+ * and we jump back to it instead of returning. The kernel keeps %ecx
+ * for both of us.
+ */
+#define __str(x) #x
+#define str(x) __str(x)
+
+__asm__(".globl _vfork\n"
+	"_vfork:\n\t"
+	"popl %ecx\n\t"
+	"movl $" str(__NR_vfork) ",%eax\n\t"
+	"int $0x80\n\t"
+	"testl %eax,%eax\n\t"
+	"jge 1f\n\t"
+	"negl %eax\n\t"
+	"movl %eax,_errno\n\t"
+	"movl $-1,%eax\n"
+	"1:\tjmp *%ecx");
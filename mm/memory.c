@@ -38,63 +38,149 @@ static inline volatile void oom(void)
 	do_exit(SIGSEGV);
 }
 
-#define invalidate() \
-	__asm__("movl %%eax,%%cr3" ::"a"(0)) // 刷新页变换高速缓冲。
-
-/* these are not to be changed without changing head.s etc */
-#define LOW_MEM 0x100000
-#define PAGING_MEMORY (15 * 1024 * 1024)
-#define PAGING_PAGES (PAGING_MEMORY >> 12)
-#define MAP_NR(addr) (((addr)-LOW_MEM) >> 12)
-#define USED 100
-
 #define CODE_SPACE(addr) ((((addr) + 4095) & ~4095) < \
 						  current->start_code + current->end_code)
 
-static long HIGH_MEMORY = 0;
+unsigned long HIGH_MEMORY = 0;
+static int paging_pages = 0;
 
 #define copy_page(from, to)                                     \
 	__asm__("cld ; rep ; movsl" ::"S"(from), "D"(to), "c"(1024) \
 			: "cx", "di", "si")
 
-static unsigned char mem_map[PAGING_PAGES] = {
-	0,
-};
+unsigned char *mem_map = NULL;
+
+static int shrink_text_pages(void);
+static void unshare_table(unsigned long *dir);
+
+static unsigned long nr_tables_shared = 0;
+static unsigned long nr_tables_copied = 0;
+static unsigned long nr_tables_reused = 0;
+
+/*
+ * Free pages are kept on two stacks, linked through their first word:
+ * free_pages holds pages with whatever was in them, zero_pages holds
+ * pages that are already cleared. Both are O(1) to push and pop, so
+ * nobody scans mem_map[] any more - it just keeps the reference counts,
+ * and a page goes on a stack when its count drops to 0.
+ *
+ * get_free_page() must return a cleared page. It takes one from
+ * zero_pages if it can, and otherwise clears one itself. The idle task
+ * refills zero_pages (see sys_pause()), so that the clearing is mostly
+ * done when nobody else wants the cpu.
+ *
+ * Pages are taken at interrupt time too (get_free_page_atomic()), so the
+ * stacks and their counts are only ever touched with interrupts off. The
+ * clearing is done outside of that.
+ */
+#define ZERO_POOL_MAX 64
+#define ZERO_BATCH 8
+
+static unsigned long free_pages = 0;
+static unsigned long zero_pages = 0;
+static int nr_free_pages = 0;
+static int nr_zero_pages = 0;
+
+static unsigned long nr_zero_hits = 0;
+static unsigned long nr_zero_misses = 0;
+
+#define clear_page(page)                                    \
+	__asm__("cld ; rep ; stosl" ::"a"(0), "D"(page), "c"(1024) \
+			: "cx", "di")
+
+#define push_page(list, page)                   \
+	do                                          \
+	{                                           \
+		*(unsigned long *)(page) = (list);      \
+		(list) = (page);                        \
+	} while (0)
+
+#define pop_page(list, page)                    \
+	do                                          \
+	{                                           \
+		(page) = (list);                        \
+		(list) = *(unsigned long *)(page);      \
+	} while (0)
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Get physical address of a free page, cleared, and mark it used. If no
+ * free pages are left, return 0. This one never sleeps and doesn't try
+ * to make room, so it can be used at interrupt time: get_free_page()
+ * below drops cached text and buffers, and may swap.
  */
-// 在主内存区中取空闲屋里页面。如果已经没有可用物理内存页面，则返回0.
-// 输入：%1(ax=0) - 0; %2(LOW_MEM)内存字节位图管理的其实位置；%3(cx=PAGING_PAGES);
-// %4(edi=mem_map+PAGING_PAGES-1).
-// 输出：返回%0(ax=物理内存页面起始地址)。
-// 上面%4寄存器实际指向mem_map[]内存字节位图的最后一个字节。本函数从位图末端开
-// 始向前扫描所有页面标志（页面总数PAGING_PAGE），若有页面空闲（内存位图字节为
-// 0）则返回页面地址。注意！本函数只是指出在主内存区的一页空闲物理内存页面，但
-// 并没有映射到某个进程的地址空间中去。后面的put_page()函数即用于把指定页面映射
-// 到某个进程地址空间中。当然对于内核使用本函数并不需要再使用put_page()进行映射，
-// 因为内核代码和数据空间（16MB）已经对等地映射到物理地址空间。
+unsigned long get_free_page_atomic(void)
+{
+	unsigned long page = 0, flags;
+	int zeroed = 0;
+
+	save_flags(flags);
+	cli();
+	if (zero_pages)
+	{
+		pop_page(zero_pages, page);
+		nr_zero_pages--;
+		nr_zero_hits++;
+		zeroed = 1;
+	}
+	else if (free_pages)
+	{
+		pop_page(free_pages, page);
+		nr_free_pages--;
+		nr_zero_misses++;
+	}
+	if (page)
+		mem_map[MAP_NR(page)] = 1;
+	restore_flags(flags);
+	if (!page)
+		return 0;
+	if (zeroed)
+		*(unsigned long *)page = 0;
+	else
+		clear_page(page);
+	return page;
+}
+
 unsigned long get_free_page(void)
 {
-	register unsigned long __res asm("ax");
-
-	__asm__("std ; repne ; scasb\n\t"
-			"jne 1f\n\t"
-			"movb $1,1(%%edi)\n\t"
-			"sall $12,%%ecx\n\t"
-			"addl %2,%%ecx\n\t"
-			"movl %%ecx,%%edx\n\t"
-			"movl $1024,%%ecx\n\t"
-			"leal 4092(%%edx),%%edi\n\t"
-			"rep ; stosl\n\t"
-			"movl %%edx,%%eax\n"
-			"1:"
-			: "=a"(__res)
-			: "0"(0), "i"(LOW_MEM), "c"(PAGING_PAGES),
-			  "D"(mem_map + PAGING_PAGES - 1)
-			: "di", "cx", "dx");
-	return __res;
+	unsigned long page;
+
+	while (!(page = get_free_page_atomic()))
+		if (!shrink_text_pages() && !shrink_buffers() && !swap_out())
+			return 0;
+	return page;
+}
+
+int free_page_count(void)
+{
+	return nr_free_pages + nr_zero_pages;
+}
+
+/*
+ * Called by the idle task: clears a few free pages and moves them over
+ * to zero_pages. It does at most ZERO_BATCH at a time, as the kernel
+ * can't be preempted and somebody might be waiting for the cpu.
+ */
+void refill_zero_pages(void)
+{
+	unsigned long page, flags;
+	int i;
+
+	save_flags(flags);
+	for (i = 0; i < ZERO_BATCH; i++)
+	{
+		cli();
+		if (!free_pages || nr_zero_pages >= ZERO_POOL_MAX)
+			break;
+		pop_page(free_pages, page);
+		nr_free_pages--;
+		restore_flags(flags);
+		clear_page(page);
+		cli();
+		push_page(zero_pages, page);
+		nr_zero_pages++;
+		restore_flags(flags);
+	}
+	restore_flags(flags);
 }
 
 /*
@@ -106,6 +192,8 @@ unsigned long get_free_page(void)
 // 参数addr需要大于1MB.
 void free_page(unsigned long addr)
 {
+	unsigned long flags;
+
 	// 首先判断参数给定的物理地址addr的合理性。如果物理地址addr小于内存低端(1MB)
 	// 则表示在内核程序或高速缓冲中，对此不予处理。如果物理地址addr>=系统所含物
 	// 理内存最高端，则显示出错信息并且内核停止工作。
@@ -113,17 +201,16 @@ void free_page(unsigned long addr)
 		return;
 	if (addr >= HIGH_MEMORY)
 		panic("trying to free nonexistent page");
-	// 如果对参数addr验证通过，那么就根据这个物理地址换算出从内存低端开始记起的
-	// 内存页面号。页面号 ＝ (addr - LOW_MEM)/4096.可见页面号从0号开始记起。此时
-	// addr中存放着页面号。如果该页面号对应的页面映射字节不等于0，则减1返回。此
-	// 时该映射字节值应该为0，表示页面已释放。如果对应页面字节原本就是0，表示该
-	// 物理页面本来就是空闲的，说明内核代码出问题。于是显示出错信息并停机。
-	addr -= LOW_MEM;
-	addr >>= 12;
-	if (mem_map[addr]--)
+	// 引用计数减到0时，把页面压回空闲页面栈。
+	if (!mem_map[MAP_NR(addr)])
+		panic("trying to free free page");
+	if (--mem_map[MAP_NR(addr)])
 		return;
-	mem_map[addr] = 0;
-	panic("trying to free free page");
+	save_flags(flags);
+	cli();
+	push_page(free_pages, addr);
+	nr_free_pages++;
+	restore_flags(flags);
 }
 
 /*
@@ -139,7 +226,7 @@ void free_page(unsigned long addr)
 // 程0和1）的页表所占据的页面在进程被创建时由内核为其主内存区申请得到。每个页表
 // 项对应1页物理内存，因此一个页表最多可映射4MB的物理内存。
 // 参数：from - 起始线性基地址；size - 释放的字节长度。
-int free_page_tables(unsigned long from, unsigned long size)
+int free_page_tables(unsigned long *page_dir, unsigned long from, unsigned long size)
 {
 	unsigned long *pg_table;
 	unsigned long *dir, nr;
@@ -157,7 +244,7 @@ int free_page_tables(unsigned long from, unsigned long size)
 	// 项号<<2，也即(from>>20)。& 0xffc确保目录项指针范围有效，即用于屏蔽目录项
 	// 指针最后2位。因为只移动了20位，因此最后2位是页表项索引的内容，应屏蔽掉。
 	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *)((from >> 20) & 0xffc); /* _pg_dir = 0 */
+	dir = dir_entry(page_dir, from);
 	// 此时size是释放的页表个数，即页目录项数，而dir是起始目录项指针。现在开始
 	// 循环操作页目录项，依次释放每个页表中的页表项。如果当前目录项无效（P位＝0）
 	// 表示该目录项没有使用(对应的页表不存在)，则继续处理下一个目录项。否则从目
@@ -170,10 +257,20 @@ int free_page_tables(unsigned long from, unsigned long size)
 		if (!(1 & *dir))
 			continue;
 		pg_table = (unsigned long *)(0xfffff000 & *dir); // 取页表地址
+		/* a shared table: the pages belong to whoever has it last */
+		if ((unsigned long)pg_table >= LOW_MEM &&
+			mem_map[MAP_NR((unsigned long)pg_table)] > 1)
+		{
+			free_page((unsigned long)pg_table);
+			*dir = 0;
+			continue;
+		}
 		for (nr = 0; nr < 1024; nr++)
 		{
 			if (1 & *pg_table) // 若该项有效，则释放对应页。
 				free_page(0xfffff000 & *pg_table);
+			else if (*pg_table) // 页面在交换设备上。
+				swap_free(*pg_table >> 1);
 			*pg_table = 0; // 该页表项内容清零。
 			pg_table++;	   // 指向页表中下一项。
 		}
@@ -207,7 +304,7 @@ int free_page_tables(unsigned long from, unsigned long size)
 // 表，原物理内存区将被共享。此后两个进程（父进程和其子进程）将共享内存区，直到
 // 有一个进程执行写操作时，内核才会为写操作进程分配新的内存页(写时复制机制)。
 // 参数from、to是线性地址，size是需要复制（共享）的内存长度，单位是byte.
-int copy_page_tables(unsigned long from, unsigned long to, long size)
+int copy_page_tables(unsigned long *to_pg_dir, unsigned long from, unsigned long to, long size)
 {
 	unsigned long *from_page_table;
 	unsigned long *to_page_table;
@@ -224,8 +321,8 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 	if ((from & 0x3fffff) || (to & 0x3fffff)) //检测是否是从4MB边缘开始的
 		panic("copy_page_tables called with wrong alignment");
 	// from_dir 和 to_dir 都是二级目录的地址
-	from_dir = (unsigned long *)((from >> 20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *)((to >> 20) & 0xffc);
+	from_dir = dir_entry(task_dir(current), from);
+	to_dir = dir_entry(to_pg_dir, to);
 	//二级目录的索引个数
 	size = ((unsigned)(size + 0x3fffff)) >> 22;
 	// 在得到了源起始目录项指针from_dir和目的起始目录项指针to_dir以及需要复制的
@@ -238,6 +335,20 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 			panic("copy_page_tables: already exist");
 		if (!(1 & *from_dir)) //本身不存在跳过
 			continue;
+		/*
+		 * Normally the table itself is shared, read-only, and only
+		 * copied when one of us writes through it - see unshare_table().
+		 * The kernel's own tables (first fork) are below LOW_MEM and
+		 * have no mem_map[] count, so they are still copied here.
+		 */
+		if ((0xfffff000 & *from_dir) >= LOW_MEM)
+		{
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			nr_tables_shared++;
+			continue;
+		}
 		// 在验证了当前源目录项和目的项正常之后，我们取源目录项中页表地址
 		// from_page_table。为了保存目的目录项对应的页表，需要在住内存区中申请1
 		// 页空闲内存页。如果取空闲页面函数get_free_page()返回0，则说明没有申请
@@ -278,6 +389,102 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 	return 0;
 }
 
+/*
+ * share_page_tables() is copy_page_tables() for vfork(): the child gets
+ * the parent's page tables as they are, writable, so both really see the
+ * same memory until the child calls execve() or exits. Tables that are
+ * still shared copy-on-write with somebody else are made private first,
+ * or the child's writes would end up in a copy of its own.
+ */
+int share_page_tables(unsigned long *to_pg_dir, unsigned long from, unsigned long to, long size)
+{
+	unsigned long *from_dir, *to_dir;
+
+	if (!from)
+		return copy_page_tables(to_pg_dir, from, to, size);
+	if ((from & 0x3fffff) || (to & 0x3fffff))
+		panic("share_page_tables called with wrong alignment");
+	from_dir = dir_entry(task_dir(current), from);
+	to_dir = dir_entry(to_pg_dir, to);
+	size = ((unsigned)(size + 0x3fffff)) >> 22;
+	for (; size-- > 0; from_dir++, to_dir++)
+	{
+		if (1 & *to_dir)
+			panic("share_page_tables: already exist");
+		if (!(1 & *from_dir))
+			continue;
+		unshare_table(from_dir);
+		*to_dir = *from_dir;
+		mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+	}
+	invalidate();
+	return 0;
+}
+
+/*
+ * After fork() the parent and the child use the same page tables, with
+ * R/W cleared in both directory entries, which makes everything behind
+ * them read-only. The first write through such an entry ends up here,
+ * and gets a private copy of the table, with the pages copy-on-write as
+ * they always were - or, if nobody else uses the table any more, just
+ * gets the R/W bit back. Anything that changes a page table through the
+ * directory entry 'dir' has to call this first.
+ */
+static void unshare_table(unsigned long *dir)
+{
+	unsigned long *old_table, *new_table, page;
+	int nr;
+
+	if ((*dir & 3) != 1) /* not present, or already ours */
+		return;
+	old_table = (unsigned long *)(0xfffff000 & *dir);
+	if (mem_map[MAP_NR((unsigned long)old_table)] == 1)
+	{
+		*dir |= 2;
+		invalidate();
+		nr_tables_reused++;
+		return;
+	}
+	if (!(new_table = (unsigned long *)get_free_page()))
+		oom();
+/* we may have slept: the other sharers could be gone by now */
+	if (mem_map[MAP_NR((unsigned long)old_table)] == 1)
+	{
+		free_page((unsigned long)new_table);
+		*dir |= 2;
+		invalidate();
+		nr_tables_reused++;
+		return;
+	}
+	for (nr = 0; nr < 1024; nr++)
+	{
+		page = old_table[nr];
+		if (!(1 & page))
+		{
+			if (page)
+			{
+				swap_duplicate(page >> 1);
+				new_table[nr] = page;
+			}
+			continue;
+		}
+		page &= ~2;
+		old_table[nr] = new_table[nr] = page;
+		if (page >= LOW_MEM)
+			mem_map[MAP_NR(page)]++;
+	}
+	free_page((unsigned long)old_table);
+	*dir = ((unsigned long)new_table) | 7;
+	invalidate();
+	nr_tables_copied++;
+}
+
+void show_page_tables(void)
+{
+	printk("page tables: %d shared by fork, %d copied, %d reused\n\r",
+		   nr_tables_shared, nr_tables_copied, nr_tables_reused);
+}
+
 /*
  * This function puts a page in memory at the wanted address.
  * It returns the physical address of the page gotten, 0 if
@@ -292,11 +499,10 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 // Buffer - TLB),即使页表中标志P被从0修改成1.因为无效叶项不会被缓冲，因此当修改
 // 了一个无效的页表项时不需要刷新。在次就表现为不用调用Invalidate()函数。
 // 参数page是分配的主内存区中某一页面(页帧，页框)的指针;address是线性地址。
+static unsigned long map_page(unsigned long page, unsigned long address, int prot);
+
 unsigned long put_page(unsigned long page, unsigned long address)
 {
-	unsigned long tmp, *page_table;
-
-	/* NOTE !!! This uses the fact that _pg_dir=0 */
 
 	// 首先判断参数给定物理内存页面page的有效性。如果该页面位置低于LOW_MEM（1MB）
 	// 或超出系统实际含有内存高端HIGH_MEMORY，则发出警告。LOW_MEM是主内存区可能
@@ -307,12 +513,25 @@ unsigned long put_page(unsigned long page, unsigned long address)
 		printk("Trying to put page %p at %p\n", page, address);
 	if (mem_map[(page - LOW_MEM) >> 12] != 1)
 		printk("mem_map disagrees with %p at %p\n", page, address);
+	return map_page(page, address, 7);
+}
+
+/*
+ * map_page() does the work for put_page(), without the sanity checks -
+ * the page may be shared - and with the page protection bits given by
+ * the caller: 7 for a writable page, 5 for a read-only one.
+ */
+static unsigned long map_page(unsigned long page, unsigned long address, int prot)
+{
+	unsigned long tmp, *page_table;
+
 	// 然后根据参数指定的线性地址address计算其在也目录表中对应的目录项指针，并
 	// 从中取得二级页表地址。如果该目录项有效(P=1),即指定的页表在内存中，则从中
 	// 取得指定页表地址放到page_table 变量中。否则就申请一空闲页面给页表使用，并
 	// 在对应目录项中置相应标志(7 - User、U/S、R/W).然后将该页表地址放到page_table
 	// 变量中。
-	page_table = (unsigned long *)((address >> 20) & 0xffc);
+	page_table = dir_entry(task_dir(current), address);
+	unshare_table(page_table);
 	if ((*page_table) & 1)
 		page_table = (unsigned long *)(0xfffff000 & *page_table);
 	else
@@ -325,16 +544,17 @@ unsigned long put_page(unsigned long page, unsigned long address)
 	// 最后在找到的页表page_table中设置相关页表内容，即把物理页面page的地址填入
 	// 表项同时置位3个标志(U/S、W/R、P)。该页表项在页表中索引值等于线性地址位21
 	// -- 位12组成的10bit的值。每个页表共可有1024项(0 -- 0x3ff)。
-	page_table[(address >> 12) & 0x3ff] = page | 7;
+	page_table[(address >> 12) & 0x3ff] = page | prot;
 	/* no need for invalidate */
 	return page;
 }
 
 void un_wp_page(unsigned long *table_entry)
 {
-	unsigned long old_page, new_page;
+	unsigned long old_entry, old_page, new_page;
 
-	old_page = 0xfffff000 & *table_entry;
+	old_entry = *table_entry;
+	old_page = 0xfffff000 & old_entry;
 	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)] == 1)
 	{
 		*table_entry |= 2;
@@ -343,6 +563,12 @@ void un_wp_page(unsigned long *table_entry)
 	}
 	if (!(new_page = get_free_page()))
 		oom();
+/* get_free_page() may have slept, and the page been swapped out */
+	if (*table_entry != old_entry)
+	{
+		free_page(new_page);
+		return;
+	}
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;
 	*table_entry = new_page | 7;
@@ -365,15 +591,22 @@ void do_wp_page(unsigned long error_code, unsigned long address)
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)(((address >> 10) & 0xffc) + (0xfffff000 &
-															  *((unsigned long *)((address >> 20) & 0xffc)))));
+	unsigned long *dir, *page;
+
+	dir = dir_entry(task_dir(current), address);
+	unshare_table(dir);
+	page = (unsigned long *)(((address >> 10) & 0xffc) + (0xfffff000 & *dir));
+	if (!(*page & 2))
+		un_wp_page(page);
 }
 
 void write_verify(unsigned long address)
 {
-	unsigned long page;
+	unsigned long page, *dir;
 
-	if (!((page = *((unsigned long *)((address >> 20) & 0xffc))) & 1))
+	dir = dir_entry(task_dir(current), address);
+	unshare_table(dir);
+	if (!((page = *dir) & 1))
 		return;
 	page &= 0xfffff000;
 	page += ((address >> 10) & 0xffc);
@@ -399,7 +632,9 @@ void get_empty_page(unsigned long address)
  * task.
  *
  * NOTE! This assumes we have checked that p != current, and that they
- * share the same executable.
+ * share the same executable. 'to' is our page table for the address,
+ * which share_page() has set up: nothing in here may sleep, as p could
+ * go away meanwhile.
  */
 //为了节约物理内存，不同进程可能会共享同样的物理页面，举个例子：
 //同时打开两个notepad，操作系统会同时生成两个进程，但由于运行的是同样的程序，
@@ -415,10 +650,10 @@ void get_empty_page(unsigned long address)
 // 址。进程P是将被共享页面的进程。如果P进程address处的页面存在并且没有被修改过的
 // 话，就让当前进程与p进程共享之。同时还需要验证指定地址处是否已经申请了页面，若
 // 是则出错，死机。返回：1 - 页面共享处理成功；0 - 失败。
-static int try_to_share(unsigned long address, struct task_struct *p)
+static int try_to_share(unsigned long address, struct task_struct *p,
+						unsigned long to)
 {
 	unsigned long from;
-	unsigned long to;
 	unsigned long from_page;
 	unsigned long to_page;
 	unsigned long phys_addr;
@@ -429,9 +664,7 @@ static int try_to_share(unsigned long address, struct task_struct *p)
 	// 录项from_page。而'逻辑'页目录项号加上当前进程CPU 4G线性空间中起始地址对应
 	// 的页目录项，即可最后得到当前进程中地址address处页面所对应的4G线性空间中的
 	// 实际页目录项to_page。
-	from_page = to_page = ((address >> 20) & 0xffc);
-	from_page += ((p->start_code >> 20) & 0xffc);
-	to_page += ((current->start_code >> 20) & 0xffc);
+	from_page = (unsigned long)dir_entry(task_dir(p), p->start_code + address);
 	// 在得到p进程和当前进程address对应的目录项后，下面分别对进程p和当前进程进行
 	// 处理。下面首先对p进程的表项进行操作。目标是取得p进程中address对应的物理内
 	// 存页面地址，并且该物理页面存在，而且干净(没有被修改过)。
@@ -457,20 +690,11 @@ static int try_to_share(unsigned long address, struct task_struct *p)
 		return 0;
 	// 下面首先对当前进程的表项进行操作。目标是取得当前进程中address对应的页表
     // 项地址，并且该页表项还没有映射物理页面，即其P=0。
-    // 首先取当前进程页目录项内容->to.如果该目录项无效(P=0),即目录项对应的二级
-    // 页表不存在，则申请一空闲页面来存放页表，并更新目录项to_page内容，让其指向
-    // 内存页面。
-	to = *(unsigned long *)to_page;
-	if (!(to & 1))
-		if (to = get_free_page())
-			*(unsigned long *)to_page = to | 7;
-		else
-			oom();
-	// 否则取目录项中的页表地址->to，加上页表项索引值<<2，即页表项在表中偏移地址，
+    // 当前进程的页表已经由share_page()准备好了(to)。
+	// 取页表地址to，加上页表项索引值<<2，即页表项在表中偏移地址，
     // 得到页表地址->to_page.针对页表项，如果我们此时我们检查出其对应的物理页面
     // 已经存在，即页表的存在位P=1，则说明原本我们想共享进程p中对应的物理页面，
     // 但现在我们自己已经占有了(映射有)物理页面。于是说明内核出错，死机。
-	to &= 0xfffff000;
 	to_page = to + ((address >> 10) & 0xffc);
 	if (1 & *(unsigned long *)to_page)
 		panic("try_to_share: to_page already exists");
@@ -518,6 +742,7 @@ static int try_to_share(unsigned long address, struct task_struct *p)
 static int share_page(unsigned long address)
 {
 	struct task_struct **p;
+	unsigned long *dir, to;
 
 	// 首先检查一下当前进程的executable字段是否指向某执行文件的i节点，以判断本
 	// 进程是否有对应的执行文件。如果没有，则返回0.如果executable的确指向某个i
@@ -528,6 +753,24 @@ static int share_page(unsigned long address)
 		return 0;
 	if (current->executable->i_count < 2)
 		return 0;
+/*
+ * Our own page table first, as getting it may sleep. Only then look at
+ * the other tasks, and keep nothing of theirs across a sleep.
+ */
+	dir = dir_entry(task_dir(current), current->start_code + address);
+	unshare_table(dir);
+	if (!(*dir & 1))
+	{
+		if (!(to = get_free_page()))
+			oom();
+		if (*dir & 1)
+			free_page(to);
+		else
+			*dir = to | 7;
+	}
+	to = *dir & 0xfffff000;
+	if (current->executable->i_count < 2) /* the others may have gone */
+		return 0;
 	for (p = &LAST_TASK; p > &FIRST_TASK; --p)
 	{
 		if (!*p)
@@ -536,35 +779,193 @@ static int share_page(unsigned long address)
 			continue;
 		if ((*p)->executable != current->executable)
 			continue;
-		if (try_to_share(address, *p))
+		if (try_to_share(address, *p, to))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * The text page cache. Text pages that do_no_page() reads in stay in
+ * memory, hashed on (inode, offset), for as long as the in-core inode of
+ * the executable does, so exec'ing the same binary again maps them
+ * without touching the disk or the buffer cache.
+ *
+ * The cache holds a reference to each page in mem_map[], and they are
+ * only ever mapped read-only, so a write to one gets a private copy from
+ * do_wp_page(). Pages only the cache uses are given back by
+ * get_free_page() when memory gets tight, and all of an inode's pages go
+ * when the file is written, truncated or its inode is reused.
+ */
+#define NR_TEXT_PAGES 256
+#define NR_TEXT_HASH 61
+#define text_hashfn(inode, offset) \
+	((((unsigned long)(inode)) ^ ((offset) >> 12)) % NR_TEXT_HASH)
+
+struct text_page
+{
+	struct m_inode *inode; /* NULL if the slot is free */
+	unsigned long offset;
+	unsigned long page;
+	struct text_page *next;	  /* hash chain */
+	struct text_page *i_next; /* next page of the same inode */
+};
+
+static struct text_page text_pages[NR_TEXT_PAGES];
+static struct text_page *text_hash[NR_TEXT_HASH];
+static int text_hand = 0;
+
+static unsigned long nr_text_hits = 0;
+static unsigned long nr_text_shared = 0;
+static unsigned long nr_text_reads = 0;
+
+static struct text_page *find_text_page(struct m_inode *inode, unsigned long offset)
+{
+	struct text_page *p;
+
+	for (p = text_hash[text_hashfn(inode, offset)]; p; p = p->next)
+		if (p->inode == inode && p->offset == offset)
+			return p;
+	return NULL;
+}
+
+static void drop_text_page(struct text_page *p)
+{
+	struct text_page **pp;
+
+	for (pp = text_hash + text_hashfn(p->inode, p->offset); *pp != p;)
+		pp = &(*pp)->next;
+	*pp = p->next;
+	for (pp = &p->inode->i_pages; *pp != p;)
+		pp = &(*pp)->i_next;
+	*pp = p->i_next;
+	p->inode = NULL;
+	free_page(p->page);
+}
+
+static void add_text_page(struct m_inode *inode, unsigned long offset, unsigned long page)
+{
+	struct text_page *p;
+	int i;
+
+	for (i = 0; i < NR_TEXT_PAGES; i++)
+	{
+		p = text_pages + text_hand;
+		if (++text_hand >= NR_TEXT_PAGES)
+			text_hand = 0;
+		if (!p->inode)
+			break;
+	}
+	if (p->inode)
+		drop_text_page(p);
+	p->inode = inode;
+	p->offset = offset;
+	p->page = page;
+	p->next = text_hash[text_hashfn(inode, offset)];
+	text_hash[text_hashfn(inode, offset)] = p;
+	p->i_next = inode->i_pages;
+	inode->i_pages = p;
+	mem_map[MAP_NR(page)]++;
+}
+
+void free_text_pages(struct m_inode *inode)
+{
+	while (inode->i_pages)
+		drop_text_page(inode->i_pages);
+}
+
+/* frees one cached page that nobody has mapped, returns 0 if none */
+static int shrink_text_pages(void)
+{
+	struct text_page *p;
+	int i;
+
+	for (i = 0; i < NR_TEXT_PAGES; i++)
+	{
+		p = text_pages + text_hand;
+		if (++text_hand >= NR_TEXT_PAGES)
+			text_hand = 0;
+		if (p->inode && mem_map[MAP_NR(p->page)] == 1)
+		{
+			drop_text_page(p);
 			return 1;
+		}
 	}
 	return 0;
 }
 
+void show_text_cache(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < NR_TEXT_PAGES; i++)
+		if (text_pages[i].inode)
+			n++;
+	printk("text pages: %d cached, %d cache hits, %d shared, %d read from disk\n\r",
+		   n, nr_text_hits, nr_text_shared, nr_text_reads);
+}
+
 void do_no_page(unsigned long error_code, unsigned long address)
 {
 	int nr[4];
 	unsigned long tmp;
 	unsigned long page;
-	int block, i;
+	int block, i, n, offset, text;
+	struct m_inode *inode = current->executable;
+	struct text_page *p;
 
 	address &= 0xfffff000;
+	page = *dir_entry(task_dir(current), address);
+	if (page & 1)
+	{
+		page &= 0xfffff000;
+		page += (address >> 10) & 0xffc;
+		if (*(unsigned long *)page)	/* a swap entry */
+		{
+			unshare_table(dir_entry(task_dir(current), address));
+			page = 0xfffff000 & *dir_entry(task_dir(current), address);
+			page += (address >> 10) & 0xffc;
+			if (!swap_in((unsigned long *)page))
+				oom();
+			return;
+		}
+	}
 	tmp = address - current->start_code;
-	if (!current->executable || tmp >= current->end_data)
+	if (!inode || tmp >= current->end_data)
 	{
 		get_empty_page(address);
 		return;
 	}
+	text = tmp < current->end_code;
+	if (text && (p = find_text_page(inode, tmp)))
+	{
+		mem_map[MAP_NR(p->page)]++;
+		if (map_page(p->page, address, 5))
+		{
+			nr_text_hits++;
+			return;
+		}
+		free_page(p->page);
+		oom();
+	}
 	if (share_page(tmp))
+	{
+		nr_text_shared++;
 		return;
+	}
 	if (!(page = get_free_page()))
 		oom();
-	/* remember that 1 block is used for header */
-	block = 1 + tmp / BLOCK_SIZE;
-	for (i = 0; i < 4; block++, i++)
-		nr[i] = bmap(current->executable, block);
-	bread_page(page, current->executable->i_dev, nr);
+	/*
+	 * remember that the first 1kB is the header: with 4kB blocks a page
+	 * is the end of one block and the start of the next.
+	 */
+	block = (tmp + BLOCK_SIZE) >> inode->i_blkbits;
+	offset = (tmp + BLOCK_SIZE) & (I_BLOCK_SIZE(inode) - 1);
+	n = (offset + PAGE_SIZE + I_BLOCK_SIZE(inode) - 1) >> inode->i_blkbits;
+	for (i = bmap_range(inode, block, nr, n); i < n; i++)
+		nr[i] = 0;
+	bread_page(page, inode->i_dev, nr, offset);
+	nr_text_reads++;
 	i = tmp + 4096 - current->end_data;
 	tmp = page + 4096;
 	while (i-- > 0)
@@ -572,24 +973,67 @@ void do_no_page(unsigned long error_code, unsigned long address)
 		tmp--;
 		*(char *)tmp = 0;
 	}
-	if (put_page(page, address))
+/* somebody else may have read the same page while we slept */
+	tmp = address - current->start_code;
+	if (text && !find_text_page(inode, tmp))
+		add_text_page(inode, tmp, page);
+	if (map_page(page, address, (mem_map[MAP_NR(page)] > 1) ? 5 : 7))
 		return;
 	free_page(page);
 	oom();
 }
 
+/*
+ * head.s only maps the first 16Mb. paging_init() maps the rest of
+ * physical memory with page tables taken from the start of main memory,
+ * and puts mem_map[] there too: it's too big to be a static array now.
+ * The tables go in the kernel part of pg_dir, which copy_mem() copies
+ * into every new page directory. Returns the new start of main memory.
+ */
+long paging_init(long start_mem, long end_mem)
+{
+	unsigned long *pg_table, address;
+	int i;
+
+	paging_pages = MAP_NR(end_mem);
+	mem_map = (unsigned char *)start_mem;
+	start_mem += paging_pages;
+	start_mem = (start_mem + 4095) & 0xfffff000;
+	for (address = 16 * 1024 * 1024; address < end_mem; address += 4 * 1024 * 1024)
+	{
+		pg_table = (unsigned long *)start_mem;
+		start_mem += 4096;
+		for (i = 0; i < 1024; i++)
+			pg_table[i] = (address + (i << 12)) | 7;
+		*dir_entry(pg_dir, address) = ((unsigned long)pg_table) | 7;
+	}
+	invalidate();
+	return start_mem;
+}
+
 void mem_init(long start_mem, long end_mem)
 {
 	int i;
 
 	HIGH_MEMORY = end_mem;
-	for (i = 0; i < PAGING_PAGES; i++)
+	for (i = 0; i < paging_pages; i++)
 		mem_map[i] = USED;
 	i = MAP_NR(start_mem);
 	end_mem -= start_mem;
 	end_mem >>= 12;
 	while (end_mem-- > 0)
-		mem_map[i++] = 0;
+	{
+		mem_map[i] = 0;
+		push_page(free_pages, LOW_MEM + (i << 12));
+		nr_free_pages++;
+		i++;
+	}
+}
+
+void show_free_pages(void)
+{
+	printk("free pages: %d (%d cleared), %d cleared on demand, %d taken from the pool\n\r",
+		   nr_free_pages + nr_zero_pages, nr_zero_pages, nr_zero_misses, nr_zero_hits);
 }
 
 void calc_mem(void)
@@ -597,15 +1041,15 @@ void calc_mem(void)
 	int i, j, k, free = 0;
 	long *pg_tbl;
 
-	for (i = 0; i < PAGING_PAGES; i++)
+	for (i = 0; i < paging_pages; i++)
 		if (!mem_map[i])
 			free++;
-	printk("%d pages free (of %d)\n\r", free, PAGING_PAGES);
-	for (i = 2; i < 1024; i++)
+	printk("%d pages free (of %d)\n\r", free, paging_pages);
+	for (i = TASK_BASE >> 22; i < 1024; i++)
 	{
-		if (1 & pg_dir[i])
+		if (1 & task_dir(current)[i])
 		{
-			pg_tbl = (long *)(0xfffff000 & pg_dir[i]);
+			pg_tbl = (long *)(0xfffff000 & task_dir(current)[i]);
 			for (j = k = 0; j < 1024; j++)
 				if (pg_tbl[j] & 1)
 					k++;
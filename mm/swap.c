@@ -0,0 +1,314 @@
+/*
+ *  linux/mm/swap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * This file handles paging to the swap device. A page that has been
+ * written out leaves its swap page number in the page table entry,
+ * shifted up one bit so that the present bit stays clear: do_no_page()
+ * sees a non-zero entry that isn't present and calls swap_in().
+ * swap_out() is what get_free_page() falls back to when there is
+ * nothing else left to free.
+ *
+ * The swap device is set in the boot sector like the root device, 0
+ * meaning no swapping. Its first page is a bitmap of the usable pages,
+ * with the signature "SWAP-SPACE" in the last 10 bytes (see mkswap).
+ */
+#include <string.h>
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/head.h>
+#include <linux/kernel.h>
+
+#define SWAP_BITS (4096 << 3)
+
+/*
+ * swap_map has a byte for each page on the device: the number of page
+ * table entries that point at it (they can be shared after a fork, see
+ * unshare_table()), or SWAP_UNUSED for pages that may not be used.
+ * SWAP_LOCKED is added while the page is being written, and swap_in()
+ * waits for it to go away. The map is kept in free pages, 4096 entries
+ * a page, so only as much of it as the device needs is allocated.
+ */
+#define SWAP_UNUSED 0x7f
+#define SWAP_LOCKED 0x80
+#define SWAP_MAP_PAGES (SWAP_BITS / PAGE_SIZE)
+
+#define SWAP_MAP(nr) (swap_map[(nr) >> 12][(nr) & 0xfff])
+#define SWAP_COUNT(nr) (SWAP_MAP(nr) & ~SWAP_LOCKED)
+
+#define read_swap_page(nr, buffer) ll_rw_page(READ, SWAP_DEV, (nr), (buffer))
+#define write_swap_page(nr, buffer) ll_rw_page(WRITE, SWAP_DEV, (nr), (buffer))
+
+int SWAP_DEV = 0;
+
+static unsigned char *swap_map[SWAP_MAP_PAGES] = {NULL, };
+static int swap_pages = 0;
+static int swap_free_pages = 0;
+static int swap_hint = 1;
+static struct task_struct *swap_wait = NULL;
+
+static unsigned long nr_swapped_out = 0;
+static unsigned long nr_swapped_in = 0;
+static unsigned long nr_swap_scanned = 0;
+
+static inline int bit(char *addr, unsigned int nr)
+{
+	return (addr[nr >> 3] >> (nr & 7)) & 1;
+}
+
+static int get_swap_page(void)
+{
+	int i, nr;
+
+	if (!swap_free_pages)
+		return 0;
+	for (i = 1; i < swap_pages; i++)
+	{
+		nr = swap_hint;
+		if (++swap_hint >= swap_pages)
+			swap_hint = 1;
+		if (!SWAP_MAP(nr))
+		{
+			SWAP_MAP(nr) = 1;
+			swap_free_pages--;
+			return nr;
+		}
+	}
+	return 0;
+}
+
+void swap_free(int nr)
+{
+	if (nr <= 0 || nr >= swap_pages || !SWAP_COUNT(nr) ||
+		SWAP_COUNT(nr) == SWAP_UNUSED)
+	{
+		printk("swap_free: bad swap page %d\n\r", nr);
+		return;
+	}
+	if (!--SWAP_MAP(nr))
+		swap_free_pages++;
+}
+
+void swap_duplicate(int nr)
+{
+	if (nr <= 0 || nr >= swap_pages || !SWAP_COUNT(nr) ||
+		SWAP_COUNT(nr) >= SWAP_UNUSED - 1)
+		panic("swap_duplicate: bad swap page");
+	SWAP_MAP(nr)++;
+}
+
+/*
+ * Bring back the page whose swap entry is in *table_ptr. The table must
+ * be one we own, ie unshare_table() has been done. Returns 0 if we are
+ * out of memory.
+ */
+int swap_in(unsigned long *table_ptr)
+{
+	unsigned long entry, page;
+	int nr;
+
+	entry = *table_ptr;
+	nr = entry >> 1;
+	if (!swap_pages || nr <= 0 || nr >= swap_pages)
+	{
+		printk("trying to swap in bad page %08x\n\r", entry);
+		*table_ptr = 0;
+		return 1;
+	}
+	if (!(page = get_free_page()))
+		return 0;
+	while (SWAP_MAP(nr) & SWAP_LOCKED)
+		sleep_on(&swap_wait);
+	if (*table_ptr != entry)
+	{
+		free_page(page);
+		return 1;
+	}
+	read_swap_page(nr, (char *)page);
+	if (*table_ptr != entry)
+	{
+		free_page(page);
+		return 1;
+	}
+	*table_ptr = page | 7;
+	swap_free(nr);
+	nr_swapped_in++;
+	return 1;
+}
+
+/*
+ * Only private pages of user memory go out: a page that somebody else
+ * maps too (a cached text page, or one shared after fork) is left alone.
+ * A page that has been used since we last looked gets its accessed bit
+ * cleared and another chance - this is the clock algorithm.
+ */
+static int try_to_swap_out(unsigned long *table_ptr)
+{
+	unsigned long page;
+	int nr;
+
+	page = *table_ptr;
+	if (!(page & 1))
+		return 0;
+	if (page & 0x20)
+	{
+		*table_ptr &= ~0x20;
+		return 0;
+	}
+	page &= 0xfffff000;
+	if (page < LOW_MEM || page >= HIGH_MEMORY)
+		return 0;
+	if (mem_map[MAP_NR(page)] != 1)
+		return 0;
+	if (!(nr = get_swap_page()))
+		return 0;
+	*table_ptr = nr << 1;
+	invalidate();
+	SWAP_MAP(nr) |= SWAP_LOCKED;
+	write_swap_page(nr, (char *)page);
+	SWAP_MAP(nr) &= ~SWAP_LOCKED;
+	if (!SWAP_MAP(nr))
+		swap_free_pages++;
+	wake_up(&swap_wait);
+	free_page(page);
+	nr_swapped_out++;
+	return 1;
+}
+
+/*
+ * The clock hand goes round the user part of every task's page directory
+ * (task 0 runs in the kernel's tables, so it's left out), and remembers
+ * where it stopped. Two full turns without finding anything means that
+ * everything is in use, or shared, and we give up.
+ */
+#define FIRST_VM_DIR (TASK_BASE >> 22)
+#define LAST_VM_DIR ((TASK_BASE + TASK_SIZE) >> 22)
+
+static int swap_task = 1;
+static int swap_dir = FIRST_VM_DIR;
+static int swap_page = 0;
+
+static void next_swap_dir(void)
+{
+	swap_page = 0;
+	if (++swap_dir < LAST_VM_DIR)
+		return;
+	swap_dir = FIRST_VM_DIR;
+	if (++swap_task >= NR_TASKS)
+		swap_task = 1;
+}
+
+int swap_out(void)
+{
+	unsigned long pg_table;
+	int counter;
+
+	if (!swap_free_pages)
+		return 0;
+	counter = 2 * (NR_TASKS - 1) * (TASK_SIZE >> 12);
+	while (counter > 0)
+	{
+		if (!task[swap_task])
+		{
+			counter -= (LAST_VM_DIR - swap_dir) * 1024 - swap_page;
+			swap_dir = LAST_VM_DIR - 1;
+			next_swap_dir();
+			continue;
+		}
+		pg_table = task_dir(task[swap_task])[swap_dir];
+		if (!(pg_table & 1))
+		{
+			counter -= 1024 - swap_page;
+			next_swap_dir();
+			continue;
+		}
+		pg_table &= 0xfffff000;
+		nr_swap_scanned++;
+		counter--;
+		if (try_to_swap_out(swap_page + (unsigned long *)pg_table))
+		{
+			if (++swap_page >= 1024)
+				next_swap_dir();
+			return 1;
+		}
+		if (++swap_page >= 1024)
+			next_swap_dir();
+	}
+	/* the accessed bits we cleared may still be in the tlb */
+	invalidate();
+	return 0;
+}
+
+void show_swap(void)
+{
+	if (!swap_pages)
+		return;
+	printk("swap: %d of %d pages free, %d out, %d in, %d ptes scanned\n\r",
+		   swap_free_pages, swap_pages, nr_swapped_out, nr_swapped_in,
+		   nr_swap_scanned);
+}
+
+/*
+ * Called by the driver of the swap device once it knows how big it is,
+ * swap_size being in blocks.
+ */
+void init_swapping(int swap_size)
+{
+	int i, j;
+	char *header;
+
+	if (!SWAP_DEV || !swap_size)
+		return;
+	if (swap_size < 100)
+	{
+		printk("Swap device too small (%d blocks)\n\r", swap_size);
+		return;
+	}
+	swap_size >>= 2;
+	if (swap_size > SWAP_BITS)
+		swap_size = SWAP_BITS;
+	if (!(header = (char *)get_free_page()))
+	{
+		printk("Unable to start swapping: out of memory :-)\n\r");
+		return;
+	}
+	read_swap_page(0, header);
+	if (strncmp("SWAP-SPACE", header + 4086, 10))
+	{
+		printk("Unable to find swap-space signature\n\r");
+		free_page((long)header);
+		return;
+	}
+	memset(header + 4086, 0, 10);
+	for (i = 0; i < (swap_size + 4095) >> 12; i++)
+		if (!(swap_map[i] = (unsigned char *)get_free_page()))
+		{
+			printk("Unable to start swapping: out of memory :-)\n\r");
+			while (i-- > 0)
+				free_page((long)swap_map[i]);
+			free_page((long)header);
+			return;
+		}
+	swap_pages = swap_size;
+	for (i = 0; i < swap_pages; i++)
+		SWAP_MAP(i) = bit(header, i) ? 0 : SWAP_UNUSED;
+	SWAP_MAP(0) = SWAP_UNUSED;
+	free_page((long)header);
+	for (i = j = 0; i < swap_pages; i++)
+		if (!SWAP_MAP(i))
+			j++;
+	if (!j)
+	{
+		printk("Swap device has no usable pages\n\r");
+		for (i = 0; i < (swap_pages + 4095) >> 12; i++)
+			free_page((long)swap_map[i]);
+		swap_pages = 0;
+		return;
+	}
+	swap_free_pages = j;
+	printk("Swap device ok: %d pages (%d bytes) swap-space\n\r", j, j * 4096);
+}
@@ -0,0 +1,372 @@
+/*
+ *  linux/tools/dirindex.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * This builds or checks the hash index of a directory on a minix
+ * filesystem image (see include/linux/dir_index.h):
+ *
+ *	dirindex build image /usr/bin
+ *	dirindex verify image /usr/bin
+ *
+ * "build" rewrites the directory in the hashed layout, allocating more
+ * zones from the image if it needs them. The result is still a normal
+ * directory to anything that doesn't know about the index. "verify"
+ * checks that every name can be found through the index, and exits with
+ * 1 if not. Only 1kB zones and directories that fit in the direct and
+ * single indirect zones are handled.
+ *
+ * The image must not be mounted while this runs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../include/linux/dir_index.h"
+
+#define BLOCK_SIZE 1024
+#define NAME_LEN 14
+#define ROOT_INO 1
+#define SUPER_MAGIC 0x137F
+
+#define ENTRIES (BLOCK_SIZE/sizeof(struct dir_entry))
+#define MAX_BLOCKS (7+512)
+/* fill buckets to 3/4 when building, so there is room to add names */
+#define BUCKET_FILL (ENTRIES*3/4)
+
+/* the on-disk structures, with sizes that don't depend on the host */
+struct d_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_nzones;
+	unsigned short s_imap_blocks;
+	unsigned short s_zmap_blocks;
+	unsigned short s_firstdatazone;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct d_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned int i_size;
+	unsigned int i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_zone[9];
+};
+
+struct dir_entry {
+	unsigned short inode;
+	char name[NAME_LEN];
+};
+
+static int fd;
+static struct d_super_block sb;
+static unsigned char * zmap;
+
+void die(char * str)
+{
+	fprintf(stderr,"dirindex: %s\n",str);
+	exit(1);
+}
+
+void usage(void)
+{
+	fprintf(stderr,"Usage: dirindex build|verify image directory\n");
+	exit(1);
+}
+
+static void rw_block(int write_it, int nr, void * buf)
+{
+	if (lseek(fd,(off_t) nr*BLOCK_SIZE,SEEK_SET) < 0)
+		die("seek failed");
+	if (write_it) {
+		if (write(fd,buf,BLOCK_SIZE) != BLOCK_SIZE)
+			die("write failed");
+	} else if (read(fd,buf,BLOCK_SIZE) != BLOCK_SIZE)
+		die("read failed");
+}
+
+static int inode_block(int nr)
+{
+	if (nr < 1 || nr > sb.s_ninodes)
+		die("bad inode number");
+	return 2 + sb.s_imap_blocks + sb.s_zmap_blocks +
+		(nr-1) / (BLOCK_SIZE/sizeof(struct d_inode));
+}
+
+static void read_inode(int nr, struct d_inode * inode)
+{
+	struct d_inode buf[BLOCK_SIZE/sizeof(struct d_inode)];
+
+	rw_block(0,inode_block(nr),buf);
+	*inode = buf[(nr-1) % (BLOCK_SIZE/sizeof(struct d_inode))];
+}
+
+static void write_inode(int nr, struct d_inode * inode)
+{
+	struct d_inode buf[BLOCK_SIZE/sizeof(struct d_inode)];
+
+	rw_block(0,inode_block(nr),buf);
+	buf[(nr-1) % (BLOCK_SIZE/sizeof(struct d_inode))] = *inode;
+	rw_block(1,inode_block(nr),buf);
+}
+
+static int new_zone(void)
+{
+	char zero[BLOCK_SIZE];
+	int i, nr = sb.s_nzones - sb.s_firstdatazone + 1;
+
+	for (i = 1 ; i < nr ; i++)
+		if (!(zmap[i>>3] & (1 << (i & 7)))) {
+			zmap[i>>3] |= 1 << (i & 7);
+			memset(zero,0,BLOCK_SIZE);
+			rw_block(1,i + sb.s_firstdatazone - 1,zero);
+			return i + sb.s_firstdatazone - 1;
+		}
+	die("no free zones left on the image");
+	return 0;
+}
+
+/* zone of logical block nr of an inode, allocating it if create is set */
+static int bmap(struct d_inode * inode, int nr, int create)
+{
+	unsigned short ind[BLOCK_SIZE/2];
+
+	if (nr < 7) {
+		if (!inode->i_zone[nr] && create)
+			inode->i_zone[nr] = new_zone();
+		return inode->i_zone[nr];
+	}
+	if ((nr -= 7) >= 512)
+		die("directory too big");
+	if (!inode->i_zone[7]) {
+		if (!create)
+			return 0;
+		inode->i_zone[7] = new_zone();
+	}
+	rw_block(0,inode->i_zone[7],ind);
+	if (!ind[nr] && create) {
+		ind[nr] = new_zone();
+		rw_block(1,inode->i_zone[7],ind);
+	}
+	return ind[nr];
+}
+
+static int namelen(struct dir_entry * de)
+{
+	int len = 0;
+
+	while (len < NAME_LEN && de->name[len])
+		len++;
+	return len;
+}
+
+static int lookup(struct d_inode * dir, const char * name, int len)
+{
+	struct dir_entry de[ENTRIES];
+	int i, block, nblocks = (dir->i_size + BLOCK_SIZE-1) / BLOCK_SIZE;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	for (block = 0 ; block < nblocks ; block++) {
+		if (!(i = bmap(dir,block,0)))
+			continue;
+		rw_block(0,i,de);
+		for (i = 0 ; i < ENTRIES ; i++)
+			if (de[i].inode && namelen(de+i) == len &&
+			    !strncmp(de[i].name,name,len))
+				return de[i].inode;
+	}
+	return 0;
+}
+
+static int namei(const char * path)
+{
+	struct d_inode dir;
+	const char * p;
+	int nr = ROOT_INO;
+
+	while (*path) {
+		while (*path == '/')
+			path++;
+		if (!*path)
+			break;
+		for (p = path ; *p && *p != '/' ; p++)
+			/* nothing */ ;
+		read_inode(nr,&dir);
+		if ((dir.i_mode & 0170000) != 0040000)
+			die("not a directory");
+		if (!(nr = lookup(&dir,path,p-path)))
+			die("no such file or directory");
+		path = p;
+	}
+	return nr;
+}
+
+/* reads all the blocks of a directory into one array */
+static struct dir_entry * read_dir(struct d_inode * dir, int * nblocks)
+{
+	struct dir_entry * de;
+	int i, zone;
+
+	*nblocks = (dir->i_size + BLOCK_SIZE-1) / BLOCK_SIZE;
+	if (*nblocks > MAX_BLOCKS)
+		die("directory too big");
+	if (!(de = calloc(MAX_BLOCKS,BLOCK_SIZE)))
+		die("out of memory");
+	for (i = 0 ; i < *nblocks ; i++)
+		if ((zone = bmap(dir,i,0)))
+			rw_block(0,zone,de + i*ENTRIES);
+	for (i = dir->i_size / sizeof(struct dir_entry) ; i < *nblocks*ENTRIES ; i++)
+		de[i].inode = 0;
+	return de;
+}
+
+static void build(int nr, struct d_inode * dir)
+{
+	struct dir_entry * old, * new;
+	struct dir_index * di;
+	int count[MAX_BLOCKS+1];
+	int i, j, b, n, nblocks, nbuckets, first = 0, last, overflow = 0;
+
+	old = read_dir(dir,&nblocks);
+	if (!(new = calloc(MAX_BLOCKS,BLOCK_SIZE)))
+		die("out of memory");
+/* "." and ".." stay where they are */
+	for (i = 0 ; i < 2 && old[i].inode && old[i].name[0] == '.' ; i++)
+		new[i] = old[first++];
+	for (n = 0, i = first ; i < nblocks*ENTRIES ; i++)
+		if (old[i].inode)
+			n++;
+	nbuckets = (n + BUCKET_FILL-1) / BUCKET_FILL;
+	if (!nbuckets)
+		nbuckets = 1;
+	if (nbuckets >= MAX_BLOCKS)
+		die("directory too big");
+	di = DIR_INDEX_SLOT + (struct dir_index *) new;
+	di->magic = DIR_INDEX_MAGIC;
+	di->nbuckets = nbuckets;
+	memset(count,0,sizeof(count));
+	count[0] = DIR_INDEX_SLOT+1;
+	last = nbuckets;
+	for (i = first ; i < nblocks*ENTRIES ; i++) {
+		if (!old[i].inode)
+			continue;
+		b = dir_index_block(di,old[i].name,namelen(old+i));
+		if (count[b] >= ENTRIES)
+			b = 0;
+		if (count[b] >= ENTRIES) {
+			for (b = nbuckets+1 ; b <= last && count[b] >= ENTRIES ; b++)
+				/* nothing */ ;
+			if (b >= MAX_BLOCKS)
+				die("directory too big");
+			last = b;
+			overflow = 1;
+		}
+		new[b*ENTRIES + count[b]++] = old[i];
+	}
+	if (overflow)
+		di->flags |= DIR_INDEX_OVERFLOW;
+/* never shrink: blocks we don't need any more just stay empty */
+	if (last+1 > nblocks)
+		nblocks = last+1;
+	for (j = 0 ; j < nblocks ; j++)
+		rw_block(1,bmap(dir,j,1),new + j*ENTRIES);
+	dir->i_size = nblocks * BLOCK_SIZE;
+	di->mtime = dir->i_time;
+	di->size = dir->i_size;
+	rw_block(1,bmap(dir,0,0),new);
+	write_inode(nr,dir);
+	printf("%d names, %d buckets%s\n",n,nbuckets,
+		overflow ? ", some overflowed" : "");
+	free(old);
+	free(new);
+}
+
+static int verify(struct d_inode * dir)
+{
+	struct dir_entry * de;
+	struct dir_index * di;
+	int i, b, n = 0, max = 0, load, nblocks, errors = 0, overflow = 0;
+
+	de = read_dir(dir,&nblocks);
+	di = DIR_INDEX_SLOT + (struct dir_index *) de;
+	if (nblocks < 2 || di->inode || di->magic != DIR_INDEX_MAGIC ||
+	    !di->nbuckets || di->nbuckets >= nblocks) {
+		printf("no index\n");
+		return 1;
+	}
+	if (di->mtime != dir->i_time || di->size != dir->i_size) {
+		printf("stale index (directory changed without updating it)\n");
+		return 1;
+	}
+	for (b = 0 ; b < nblocks ; b++) {
+		load = 0;
+		for (i = b*ENTRIES ; i < (b+1)*ENTRIES ; i++) {
+			if (!de[i].inode)
+				continue;
+			n++;
+			load++;
+			if (!b || dir_index_block(di,de[i].name,namelen(de+i)) == b)
+				continue;
+			overflow++;
+			if (!(di->flags & DIR_INDEX_OVERFLOW)) {
+				printf("%.14s: in block %d, but hashes to %d\n",
+					de[i].name,b,
+					dir_index_block(di,de[i].name,namelen(de+i)));
+				errors++;
+			}
+		}
+		if (b && b <= di->nbuckets && load > max)
+			max = load;
+	}
+	printf("%d names, %d buckets (fullest has %d), %d overflowed%s\n",
+		n,di->nbuckets,max,overflow,
+		(di->flags & DIR_INDEX_OVERFLOW) ? " (flagged)" : "");
+	free(de);
+	return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+	struct d_inode dir;
+	char buf[BLOCK_SIZE];
+	int nr, i, do_build;
+
+	if (argc != 4)
+		usage();
+	if (!strcmp(argv[1],"build"))
+		do_build = 1;
+	else if (!strcmp(argv[1],"verify"))
+		do_build = 0;
+	else
+		usage();
+	if ((fd = open(argv[2],do_build ? O_RDWR : O_RDONLY)) < 0)
+		die("unable to open image");
+	rw_block(0,1,buf);
+	memcpy(&sb,buf,sizeof(sb));
+	if (sb.s_magic != SUPER_MAGIC)
+		die("not a minix filesystem");
+	if (sb.s_log_zone_size)
+		die("only 1kB zones are supported");
+	if (!(zmap = malloc(sb.s_zmap_blocks*BLOCK_SIZE)))
+		die("out of memory");
+	for (i = 0 ; i < sb.s_zmap_blocks ; i++)
+		rw_block(0,2+sb.s_imap_blocks+i,zmap+i*BLOCK_SIZE);
+	nr = namei(argv[3]);
+	read_inode(nr,&dir);
+	if ((dir.i_mode & 0170000) != 0040000)
+		die("not a directory");
+	if (!do_build)
+		return verify(&dir);
+	build(nr,&dir);
+	for (i = 0 ; i < sb.s_zmap_blocks ; i++)
+		rw_block(1,2+sb.s_imap_blocks+i,zmap+i*BLOCK_SIZE);
+	return verify(&dir);
+}
@@ -0,0 +1,214 @@
+/*
+ *  linux/tools/mkfs.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * This makes an empty minix filesystem on an image file or a device:
+ *
+ *	mkfs [-b blocksize] [-i inodes] image kbytes
+ *
+ * The block size is 1024 (the default, a normal minix filesystem) or
+ * 4096. With 4kB blocks s_log_zone_size is 2 and every block number on
+ * the filesystem is in 4kB units: see FIRST_MAP_BLOCK() in <linux/fs.h>.
+ * The super block is at 1kB either way. Zone numbers are 16 bits, so a
+ * filesystem has at most 65535 blocks, 64MB or 256MB.
+ *
+ * There is one inode for every 4kB unless -i says otherwise. The root
+ * directory gets inode 1 and the first data block. An image file is
+ * made as long as it needs to be; the boot block is left alone.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BLOCK_SIZE 1024
+#define MAX_BLOCK_SIZE 4096
+#define NAME_LEN 14
+#define ROOT_INO 1
+#define SUPER_MAGIC 0x137F
+#define MAX_ZONES 65535
+
+/* the on-disk structures, with sizes that don't depend on the host */
+struct d_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_nzones;
+	unsigned short s_imap_blocks;
+	unsigned short s_zmap_blocks;
+	unsigned short s_firstdatazone;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct d_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned int i_size;
+	unsigned int i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_zone[9];
+};
+
+struct dir_entry {
+	unsigned short inode;
+	char name[NAME_LEN];
+};
+
+static int fd;
+static int block_size = BLOCK_SIZE;
+
+void die(char * str)
+{
+	fprintf(stderr,"mkfs: %s\n",str);
+	exit(1);
+}
+
+void usage(void)
+{
+	fprintf(stderr,"Usage: mkfs [-b 1024|4096] [-i inodes] image kbytes\n");
+	exit(1);
+}
+
+static void write_at(long pos, void * buf, int len)
+{
+	if (lseek(fd,(off_t) pos,SEEK_SET) < 0)
+		die("seek failed");
+	if (write(fd,buf,len) != len)
+		die("write failed");
+}
+
+static void write_block(int nr, void * buf)
+{
+	write_at((long) nr*block_size,buf,block_size);
+}
+
+static void set_bit(unsigned char * map, int nr)
+{
+	map[nr>>3] |= 1 << (nr & 7);
+}
+
+/*
+ * Bit 0 of both maps is never used, and the bits past the last inode or
+ * zone are set too, so that the kernel never hands them out.
+ */
+static void write_map(int start, int blocks, int used, int last)
+{
+	unsigned char * map;
+	int i, bits = blocks*block_size*8;
+
+	if (!(map = calloc(blocks,block_size)))
+		die("out of memory");
+	for (i = 0 ; i <= used ; i++)
+		set_bit(map,i);
+	for (i = last+1 ; i < bits ; i++)
+		set_bit(map,i);
+	for (i = 0 ; i < blocks ; i++)
+		write_block(start+i,map+i*block_size);
+	free(map);
+}
+
+int main(int argc, char ** argv)
+{
+	struct d_super_block sb;
+	char block[MAX_BLOCK_SIZE];
+	struct d_inode * inode = (struct d_inode *) block;
+	struct dir_entry * de = (struct dir_entry *) block;
+	struct stat st;
+	unsigned long long max;
+	long kbytes;
+	int inodes = 0, per_block, bits, map_start, inode_blocks, nzones, i, c;
+
+	while ((c = getopt(argc,argv,"b:i:")) != -1)
+		switch (c) {
+			case 'b': block_size = atoi(optarg); break;
+			case 'i': inodes = atoi(optarg); break;
+			default: usage();
+		}
+	if (argc-optind != 2)
+		usage();
+	if (block_size != BLOCK_SIZE && block_size != MAX_BLOCK_SIZE)
+		die("the block size must be 1024 or 4096");
+	if ((kbytes = atol(argv[optind+1])) <= 0)
+		usage();
+	nzones = kbytes / (block_size/BLOCK_SIZE);
+	if (nzones > MAX_ZONES) {
+		fprintf(stderr,"mkfs: only %d blocks of %d bytes will be used\n",
+			MAX_ZONES,block_size);
+		nzones = MAX_ZONES;
+	}
+	if (!inodes)
+		inodes = kbytes/4;
+	per_block = block_size/sizeof(struct d_inode);
+	inodes = (inodes + per_block-1) / per_block * per_block;
+	if (inodes < per_block)
+		inodes = per_block;
+	if (inodes > MAX_ZONES)
+		inodes = MAX_ZONES / per_block * per_block;
+	bits = block_size*8;
+	inode_blocks = inodes / per_block;
+	map_start = (2*BLOCK_SIZE + block_size-1) / block_size;
+
+	memset(&sb,0,sizeof(sb));
+	sb.s_ninodes = inodes;
+	sb.s_nzones = nzones;
+	sb.s_imap_blocks = (inodes + 1 + bits-1) / bits;
+	sb.s_zmap_blocks = (nzones + bits-1) / bits;
+	sb.s_firstdatazone = map_start + sb.s_imap_blocks + sb.s_zmap_blocks +
+		inode_blocks;
+	sb.s_log_zone_size = (block_size == BLOCK_SIZE) ? 0 : 2;
+	max = block_size/2;
+	max = (7 + max + max*max) * block_size;
+	sb.s_max_size = (max > 0x7fffffff) ? 0x7fffffff : max;
+	sb.s_magic = SUPER_MAGIC;
+	if (sb.s_firstdatazone >= nzones)
+		die("the filesystem is too small");
+	if (sb.s_imap_blocks > 8 || sb.s_zmap_blocks > 8)
+		die("too many bitmap blocks");
+
+	if ((fd = open(argv[optind],O_RDWR | O_CREAT,0644)) < 0)
+		die("unable to open image");
+	if (fstat(fd,&st) < 0)
+		die("unable to stat image");
+	if (S_ISREG(st.st_mode) && st.st_size < (off_t) nzones*block_size)
+		if (ftruncate(fd,(off_t) nzones*block_size) < 0)
+			die("unable to extend image");
+
+	memset(block,0,BLOCK_SIZE);
+	memcpy(block,&sb,sizeof(sb));
+	write_at(BLOCK_SIZE,block,BLOCK_SIZE);
+	write_map(map_start,sb.s_imap_blocks,ROOT_INO,inodes);
+	write_map(map_start+sb.s_imap_blocks,sb.s_zmap_blocks,1,
+		nzones - sb.s_firstdatazone);
+
+	for (i = 0 ; i < inode_blocks ; i++) {
+		memset(block,0,block_size);
+		if (!i) {
+			inode->i_mode = 040755;
+			inode->i_size = 2*sizeof(struct dir_entry);
+			inode->i_time = time(NULL);
+			inode->i_nlinks = 2;
+			inode->i_zone[0] = sb.s_firstdatazone;
+		}
+		write_block(map_start+sb.s_imap_blocks+sb.s_zmap_blocks+i,block);
+	}
+
+	memset(block,0,block_size);
+	de[0].inode = ROOT_INO;
+	strcpy(de[0].name,".");
+	de[1].inode = ROOT_INO;
+	strcpy(de[1].name,"..");
+	write_block(sb.s_firstdatazone,block);
+	if (close(fd) < 0)
+		die("close failed");
+	printf("%d inodes, %d blocks of %d bytes, first data block %d\n",
+		inodes,nzones,block_size,sb.s_firstdatazone);
+	return 0;
+}